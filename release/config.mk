@@ -8,6 +8,11 @@ RESET = \033[0m
 
 V ?= 2
 D ?= 1
+KMM_BUDDY ?= 0
+VMM_PAE ?= 0
+VMM_RECURSIVE ?= 0
+SWAP_SLOTS ?= 0
+QEMU_MEM ?=
 MAKEFLAGS += --no-print-directory
 
 # Verbosity control. Inspired from the Contiki-NG build system. A few hacks here and there, will probably improve later.
@@ -33,6 +33,9 @@ static bool capslock_toggled_state = false;
 static bool numlock_toggled_state = false;
 static bool scrolllock_toggled_state = false;
 
+// work to do while waiting for input
+static kbd_idle_handler_t _kbd_idle_handler = NULL;
+
 //! private function prototypes
 
 
@@ -326,13 +329,30 @@ KBD_ENTRY kbd_getlastkey_buf()
     // wait until there is a key in the buffer
     while (_kbd_ring_buffer_empty()) 
 	{
-		
+		// let the idle handler use the time first
+		if (_kbd_idle_handler && _kbd_idle_handler())
+			continue;
+
+		// nothing to do, sleep until the next interrupt. the buffer is
+		// rechecked with interrupts off so a key arriving in between can't
+		// be missed (sti only takes effect after the hlt)
+		cli();
+
+		if (_kbd_ring_buffer_empty())
+			asm volatile ("sti; hlt" ::: "memory");
+		else
+			sti();
     }
 
 	// return the last entered key from buffer and remove it
 	return _kbd_ring_buffer_pop();
 }
 
+void kbd_set_idle_handler(kbd_idle_handler_t handler)
+{
+	_kbd_idle_handler = handler;
+}
+
 bool kbd_get_numlock()
 {
 	return numlock_toggled_state;
@@ -259,6 +259,10 @@ typedef enum __KEYCODE {
 
 } KBD_KEYCODE;
 
+//! called while waiting for a key, returns true if it did some work (the
+//! wait loop only halts the CPU once the handler has nothing left to do)
+typedef bool (*kbd_idle_handler_t)(void);
+
 //-----------------------------------------------------------------------------
 // 		INTERFACE DATA STRUCTURES
 //-----------------------------------------------------------------------------
@@ -304,6 +308,7 @@ bool kbd_get_numlock();
 
 // helpers
 void kbd_clear_buffer(void);
+void kbd_set_idle_handler(kbd_idle_handler_t handler);
 
 
 //*****************************************************************************
@@ -8,8 +8,12 @@
 #include <init/syscall.h>
 #include <stdio.h>
 #include <string.h>
+#include <driver/keyboard.h>
+#include <mm/kmm.h>
+#include <mm/vmm.h>
+#include <mm/swap.h>
 
-#define NUM_CMD 7
+#define NUM_CMD 10
 #define MAX_TOKENS 16
 #define BUFFER_SIZE 1024
 
@@ -55,6 +59,9 @@ void color_cmd(char* args);
 void bg_color_cmd(char* args);
 void repeat_text_cmd(char* args);
 void exit_cmd(char* args);
+void meminfo_cmd(char* args);
+void faultinfo_cmd(char* args);
+void wsinfo_cmd(char* args);
 
 
 #endif
\ No newline at end of file
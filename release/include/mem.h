@@ -9,10 +9,22 @@
 	constraints for the buffer, we set it up in low memory. */
 #define DMA_BUFFER_START 	  0x1000 // 4KB
 
+/* physical addresses are 32 bits wide, or 36 bits (64GB) with PAE paging, so
+	frames above 4GB can't be named by a pointer */
+#ifdef VMM_PAE
+typedef uint64_t phys_addr_t;
+#else
+typedef uint32_t phys_addr_t;
+#endif
+
 /* the bootsector code sets up page tables so that physical memory starting
 	at 0x0 can be accessed directly at 3GB and so on. */
 #define PHYSMAP_BASE 		  0xC0000000
 
+/* the physmap ends where the kernel's own virtual regions start, memory
+	above this has no permanent mapping (896MB) */
+#define PHYSMAP_MAX_SIZE 	  0x38000000
+
 /* we can then define some macros to get address translations based on physmap */
 #define PHYS_TO_VIRT(addr)    ((void*) ((uintptr_t)(addr) + PHYSMAP_BASE))
 #define VIRT_TO_PHYS(addr)    ((void*) ((uintptr_t)(addr) - PHYSMAP_BASE))
@@ -21,11 +33,16 @@
 #define KERNEL_LOAD_PHYS   	  0x00100000 // 1MB
 #define KERNEL_LOAD_VIRT   	  PHYS_TO_VIRT(KERNEL_LOAD_PHYS) // 3GB
 
+/* low page the PAE switch code is copied to, it has to run identity mapped
+	while paging is briefly turned off */
+#define PAE_TRAMPOLINE_PHYS   0x00007000
+
 /* low memory below 640 KB for initial kernel stack */
 #define KERNEL_STACK_EARLY 	  0x00090000 // ~128KB stack space.
 
-/* memory region for the kernel heap */
-#define KERNEL_HEAP_VIRT   	  0xC0200000 // 3GB + 2MB
+/* memory region for the kernel heap, right past the physmap so it never
+	aliases physical memory */
+#define KERNEL_HEAP_VIRT   	  (PHYSMAP_BASE + PHYSMAP_MAX_SIZE) // 3GB + 896MB
 #define KERNEL_HEAP_SIZE   	  0x00100000 // 1MB
 
 /* we keep the low 1MB identity mapped to enable easy access to legacy
@@ -35,6 +35,26 @@
 #define _KMM_BLOCK_SIZE         4096
 #define _KMM_BLOCK_ALIGNMENT    _KMM_BLOCK_SIZE
 
+/* most frames kmm tracks: the 4GB 32-bit physical address space, or 64GB
+    (36-bit addresses) when built with PAE paging (make VMM_PAE=1). frames
+    above 4GB have no frame descriptor and are only handed out through the
+    phys_addr_t calls */
+#ifdef VMM_PAE
+#define KMM_MAX_FRAMES          0x1000000
+#else
+#define KMM_MAX_FRAMES          0x100000
+#endif
+
+/* frames a 32-bit pointer can name */
+#define _KMM_PTR_FRAMES         0x100000
+
+/* sentinel frame number returned by the internal bitmap searches */
+#define _KMM_INVALID_FRAME      0xFFFFFFFF
+
+/* largest buddy block is 2^KMM_BUDDY_MAX_ORDER frames (4MB). only used when
+    the buddy allocator is built in (make KMM_BUDDY=1) */
+#define KMM_BUDDY_MAX_ORDER     10
+
 //-----------------------------------------------------------------------------
 // 		INTERFACE DATA STRUCTURES
 //-----------------------------------------------------------------------------
@@ -83,6 +103,68 @@ typedef struct
 
 } bitmap_frame_info_t;
 
+/* frame descriptor flags (owner and state tags) */
+#define KMM_FRAME_KERNEL        0x01    //! reserved/owned by the kernel itself
+#define KMM_FRAME_PAGETABLE     0x02    //! page directory or page table
+#define KMM_FRAME_HEAP          0x04    //! backs a kernel heap
+#define KMM_FRAME_USER          0x08    //! mapped into user space
+#define KMM_FRAME_ZEROED        0x10    //! contents are known to be zero
+#define KMM_FRAME_RESERVED      0x20    //! in an immutable reserved range, never freed
+
+/* capacity of the reserved-range table built by kmm_init (low memory, kernel
+    image, kmm metadata and memory map holes, merged when they touch) */
+#define KMM_MAX_RESERVED_RANGES 32
+
+/* per-frame descriptor, one for every frame, kept at 8 bytes so the array
+    stays small (8 bytes per 4KB frame) */
+typedef struct
+{
+    uint16_t refcount;      //! references held, 0 = free
+    uint16_t mapcount;      //! number of PTEs mapping the frame
+    uint8_t  flags;         //! KMM_FRAME_* tags
+    uint8_t  order;         //! log2 of the run size for multi-frame allocations
+    uint16_t pte_count;     //! entries in use, for page table frames
+
+} frame_desc_t;
+
+_Static_assert(sizeof(frame_desc_t) <= 8, "frame_desc_t must stay within 8 bytes");
+
+/* pool of frames that are already zeroed, refilled from the idle loop */
+#define KMM_ZERO_POOL_SIZE      64      //! frames held by the pool at most
+#define KMM_ZERO_POOL_BATCH     4       //! frames zeroed per idle call
+
+typedef struct
+{
+    uint32_t hits;          //! zeroed frames handed out from the pool
+    uint32_t misses;        //! zeroed frames that had to be cleared on the spot
+    uint32_t pooled;        //! frames currently in the pool
+
+} kmm_zero_pool_stats_t;
+
+/* called when an allocation would leave fewer free frames than the reclaim
+    watermark, with the number of frames missing. frees what it can (without
+    allocating) and returns how many frames it freed */
+typedef uint32_t (*kmm_reclaim_handler_t)(uint32_t frames);
+
+/* physical memory zones. DMA is what legacy ISA DMA can reach (below 16MB),
+    NORMAL is the rest of the memory covered by the physmap and HIGH is
+    everything above it, which has no permanent kernel mapping */
+#define KMM_ZONE_DMA            0
+#define KMM_ZONE_NORMAL         1
+#define KMM_ZONE_HIGH           2
+#define KMM_ZONE_COUNT          3
+
+#define KMM_ZONE_DMA_END        0x01000000          // 16MB
+#define KMM_ZONE_NORMAL_END     PHYSMAP_MAX_SIZE
+
+typedef struct
+{
+    uint32_t start;         //! first frame of the zone
+    uint32_t end;           //! one past the last frame of the zone
+    uint32_t free;          //! free frames inside the zone
+
+} kmm_zone_stats_t;
+
 // helpers
 void kmm_get_available_mem(void);
 void kmm_get_physical_mem_map(void);
@@ -93,8 +175,33 @@ bitmap_frame_info_t kmm_get_first_free_bit(void);
 void kmm_init(void);
 uint32_t kmm_get_total_frames(void);
 uint32_t kmm_get_used_frames(void);
+uint64_t kmm_get_init_cycles(void);
 void kmm_setup_memory_region(uint32_t base, uint32_t size, bool is_reserved);
 void* kmm_frame_alloc(void);
 void kmm_frame_free(void* phys_addr);
+void* kmm_frames_alloc(uint32_t count, uint32_t align);
+void kmm_frames_free(void* phys_addr, uint32_t count);
+frame_desc_t* kmm_frame_desc(void* phys_addr);
+uint32_t kmm_frame_get(void* phys_addr);
+uint32_t kmm_frame_put(void* phys_addr);
+void kmm_frame_set_flags(void* phys_addr, uint8_t flags);
+void* kmm_frame_alloc_zeroed(void);
+bool kmm_zero_pool_refill(void);
+void kmm_zero_pool_drain(void);
+void kmm_get_zero_pool_stats(kmm_zero_pool_stats_t* stats);
+void kmm_set_reclaim_handler(kmm_reclaim_handler_t handler, uint32_t watermark);
+void* kmm_frame_alloc_zone(uint32_t zone);
+phys_addr_t kmm_frame_alloc_phys(uint32_t zone);
+void kmm_frame_free_phys(phys_addr_t phys_addr);
+void kmm_get_zone_stats(uint32_t zone, kmm_zone_stats_t* stats);
+uint32_t kmm_frame_alloc_batch(void** frames, uint32_t count);
+uint32_t kmm_frame_alloc_batch_zeroed(void** frames, uint32_t count);
+void kmm_frame_free_batch(void** frames, uint32_t count);
+void kmm_frame_zero(void* phys_addr);
+void kmm_frame_copy(void* dst_phys, void* src_phys);
+
+#ifdef KMM_BUDDY
+uint32_t kmm_get_free_blocks(uint32_t order);
+#endif
 
 #endif // !_KMM_H
@@ -14,10 +14,36 @@
 #define PDE_SIZE_4MB        0x080       // Page size is 4MB
 #define PDE_GLOBAL          0x100       // Page is global (not flushed on context switch)
 #define PDE_LV4_GLOBAL      0x200       // Level 4 global page
+#ifdef VMM_PAE
+#define PDE_FRAME_MASK      0x0000000FFFFFF000ULL  // Mask for the 36-bit frame address in the PDE
+
+// with PAE a Page Directory Entry is 64 bits wide
+typedef uint64_t pde_t;
+
+// the page directory pointer table (PDPT) sits above the directories, its
+// entries only take the present and caching bits
+#define PDPTE_PRESENT       0x001       // Page directory is present
+#define PDPTE_FRAME_MASK    PDE_FRAME_MASK
+
+typedef uint64_t pdpte_t;
+
+#define PDPTE_DIR_ADDR(pdpte)   ((pdpte) & PDPTE_FRAME_MASK)  // Get the page directory address
+#define PDPTE_IS_PRESENT(pdpte) ((pdpte) & PDPTE_PRESENT)     // Check if the directory is present
+#else
 #define PDE_FRAME_MASK      0xFFFFF000  // Mask for the frame address in the PDE
 
 // Each Page Directory Entry is 32 bits wide, so we can represent it as a 32-bit unsigned integer
 typedef uint32_t pde_t;
+#endif
+
+// a large PDE (PDE_SIZE_4MB set) maps a whole 4MB page (2MB with PAE) itself
+#ifdef VMM_PAE
+#define PDE_LARGE_FRAME_MASK 0x0000000FFFE00000ULL  // Mask for the 2MB frame address in a large PDE
+#else
+#define PDE_LARGE_FRAME_MASK 0xFFC00000  // Mask for the 4MB frame address in a large PDE
+#endif
+
+#define PDE_LARGE_ADDR(pde)     ((pde) & PDE_LARGE_FRAME_MASK)  // Get the large page address
 
 // Using a similar interface as PTEs for creating and manipulating PDEs
 #define PDE_PTABLE_ADDR(pde)    ((pde) & PDE_FRAME_MASK)   // Get the page table address
@@ -32,8 +58,8 @@ typedef uint32_t pde_t;
 
 static inline pde_t _pde_create(void* phys_addr, uint32_t flags)
 {
-    // create first 20bit address part
-    pde_t addr_part = (pde_t)phys_addr & PDE_FRAME_MASK;
+    // create the frame address part (page tables always live below 4GB)
+    pde_t addr_part = (pde_t)(uintptr_t)phys_addr & PDE_FRAME_MASK;
 
     // create last 12bit flags part
     pde_t flags_part = flags & ~PDE_FRAME_MASK;
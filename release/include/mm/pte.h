@@ -2,6 +2,7 @@
 #define _MM_PTE_H
 
 #include <stdint.h>
+#include <mem.h>
 
 // Page Table Entry (PTE) flags
 #define PTE_PRESENT         0x001 // Page is present in memory
@@ -13,12 +14,22 @@
 #define PTE_DIRTY           0x040 // Page has been written to
 #define PTE_PAT             0x080
 #define PTE_GLOBAL          0x100 // Page is global (not flushed on context switch)
-#define PTE_LV4_GLOBAL      0x200
+#define PTE_GUARD           0x200 // (available bit) guard page, backed on touch and moved down to its stack limit
+#define PTE_COW             0x400 // (available bit) read-only share of a copy-on-write frame
+#define PTE_LAZY            0x800 // (available bit) reserved, backed by a zeroed frame on first touch
+#define PTE_SWAPPED         0x400 // (available bit, not-present entry) in swap, the frame bits hold the slot
 
+#ifdef VMM_PAE
+#define PTE_FRAME_MASK      0x0000000FFFFFF000ULL // Mask for the 36-bit frame address in the PTE
+
+// with PAE a page table entry is 64 bits wide
+typedef uint64_t pte_t;
+#else
 #define PTE_FRAME_MASK      0xFFFFF000 // Mask for the frame address in the PTE
 
 // a page table entry is 32 bits wide, so we can represent it as a 32-bit unsigned integer
 typedef uint32_t pte_t;
+#endif
 
 // utils to create and manipulate PTEs
 #define PTE_FRAME_ADDR(pte)    ((pte) & PTE_FRAME_MASK)   // Get the frame address from a PTE
@@ -38,9 +49,9 @@ typedef uint32_t pte_t;
 #define PTE_UNSET_DIRTY(pte)   ((pte) &= ~PTE_DIRTY)          // Unset the dirty flag
 
 
-static inline pte_t _pte_create(void* phys_addr, uint32_t flags)
+static inline pte_t _pte_create_phys(phys_addr_t phys_addr, uint32_t flags)
 {
-    // create first 20bit address part
+    // create the frame address part (20 bits, 24 with PAE)
     pte_t addr_part = (pte_t)phys_addr & PTE_FRAME_MASK;
 
     // create last 12bit flags part
@@ -50,5 +61,10 @@ static inline pte_t _pte_create(void* phys_addr, uint32_t flags)
     return addr_part | flags_part;
 }
 
+static inline pte_t _pte_create(void* phys_addr, uint32_t flags)
+{
+    return _pte_create_phys((phys_addr_t)(uintptr_t)phys_addr, flags);
+}
+
 
 #endif // _MM_PTE_H
\ No newline at end of file
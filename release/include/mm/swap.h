@@ -0,0 +1,67 @@
+#ifndef _SWAP_H
+#define _SWAP_H
+//*****************************************************************************
+//*
+//*  @file		swap.h
+//*  @author    
+//*  @brief	    Swap area: page-sized slots evicted pages are written to.
+//*             The area is a reserved run of RAM frames, there is no disk
+//*             driver to put it on.
+//*  @version	
+//*
+//****************************************************************************/
+//-----------------------------------------------------------------------------
+// 		REQUIRED HEADERS
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------------------------------------
+// 		INTERFACE DEFINES/TYPES
+//-----------------------------------------------------------------------------
+
+// largest swap area, in slots of one page (64MB)
+#define SWAP_SLOTS_MAX          16384
+
+// returned by swap_slot_alloc when the area is full (or missing)
+#define SWAP_NO_SLOT            0xFFFFFFFF
+
+//-----------------------------------------------------------------------------
+// 		INTERFACE DATA STRUCTURES
+//-----------------------------------------------------------------------------
+
+//! use of the swap area
+typedef struct {
+
+    //! slots in the area, 0 when there is none
+    uint32_t    slots;
+
+    //! slots holding a page
+    uint32_t    used;
+
+    //! pages written to / read from the area
+    uint32_t    writes;
+    uint32_t    reads;
+
+} swap_stats_t;
+
+//-----------------------------------------------------------------------------
+// 		INTERFACE FUNCTION PROTOTYPES
+//-----------------------------------------------------------------------------
+bool swap_init(uint32_t slots);
+bool swap_release(void);
+uint32_t swap_slot_alloc(void);
+void swap_slot_get(uint32_t slot);
+void swap_slot_put(uint32_t slot);
+void swap_write(uint32_t slot, void* frame_phys);
+void swap_read(uint32_t slot, void* frame_phys);
+void swap_get_stats(swap_stats_t* stats);
+
+//*****************************************************************************
+//**
+//** 	END swap.h
+//**
+//*****************************************************************************
+
+#endif // _SWAP_H
@@ -0,0 +1,115 @@
+#ifndef _VMA_H
+#define _VMA_H
+//*****************************************************************************
+//*
+//*  @file		vma.h
+//*  @author    
+//*  @brief	    Virtual memory areas (VMAs): the reserved ranges of the user
+//*             half of an address space, kept in an AVL tree.
+//*  @version	
+//*
+//****************************************************************************/
+//-----------------------------------------------------------------------------
+// 		REQUIRED HEADERS
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <mm/vmm.h>
+
+//-----------------------------------------------------------------------------
+// 		INTERFACE DEFINES/TYPES
+//-----------------------------------------------------------------------------
+
+// what backs the pages of a VMA
+#define VMA_BACKING_ANON        0   //! zeroed frames, allocated with the region
+#define VMA_BACKING_LAZY        1   //! zeroed frames, allocated on first touch
+#define VMA_BACKING_STACK       2   //! room a guard page moves down through
+
+// address spaces are found by their directory in a small hash table
+#define VMA_SPACE_BUCKETS       16
+
+//-----------------------------------------------------------------------------
+// 		INTERFACE DATA STRUCTURES
+//-----------------------------------------------------------------------------
+
+//! one reserved range [start, end), a node of the AVL tree of its space
+typedef struct vma {
+
+    //! page aligned bounds
+    uintptr_t       start;
+    uintptr_t       end;
+
+    //! PTE flags the pages are mapped with
+    uint32_t        flags;
+
+    //! VMA_BACKING_*
+    uint8_t         backing;
+
+    //! working-set scanner: present, accessed and dirty pages at the last
+    //! scan, accessed pages decayed by half each scan, and scans since the
+    //! last access
+    uint32_t        resident;
+    uint32_t        referenced;
+    uint32_t        dirty;
+    uint32_t        heat;
+    uint32_t        age;
+
+    //! height of the subtree rooted here
+    uint8_t         height;
+
+    //! lowest start, highest end and largest gap between two VMAs of the
+    //! subtree rooted here, kept up to date for the gap search
+    uintptr_t       min_start;
+    uintptr_t       max_end;
+    uintptr_t       subtree_gap;
+
+    struct vma*     left;
+    struct vma*     right;
+
+} vma_t;
+
+//! the VMAs of one address space, allocated from the kernel heap
+typedef struct vma_space {
+
+    //! the address space
+    pagedir_t*          pdir;
+
+    //! tree ordered by start address
+    vma_t*              root;
+
+    //! VMAs in the tree
+    uint32_t            count;
+
+    //! totals of the last working-set scan
+    vmm_ws_stats_t      ws;
+
+    //! next space in the same hash bucket
+    struct vma_space*   next;
+
+} vma_space_t;
+
+//-----------------------------------------------------------------------------
+// 		INTERFACE FUNCTION PROTOTYPES
+//-----------------------------------------------------------------------------
+void vma_init(void);
+vma_space_t* vma_space_get(pagedir_t* pdir, bool create);
+vma_space_t* vma_space_next(vma_space_t* space);
+void vma_space_destroy(pagedir_t* pdir);
+bool vma_space_clone(pagedir_t* src, pagedir_t* dst);
+vma_t* vma_find(vma_space_t* space, uintptr_t addr);
+vma_t* vma_next(vma_space_t* space, uintptr_t addr);
+bool vma_insert(vma_space_t* space, uintptr_t start, uintptr_t end, uint32_t flags, uint8_t backing);
+bool vma_remove_range(vma_space_t* space, uintptr_t start, uintptr_t end);
+uintptr_t vma_find_gap(vma_space_t* space, uintptr_t low, uintptr_t high, size_t size);
+void vma_get_counts(uint32_t* spaces, uint32_t* vmas);
+
+//*****************************************************************************
+//**
+//** 	END vma.h
+//**
+//*****************************************************************************
+
+#endif // _VMA_H
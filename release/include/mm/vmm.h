@@ -28,6 +28,30 @@
 //-----------------------------------------------------------------------------
 
 #define VMM_PAGE_SIZE           4096    //! 4KB page size
+
+#ifdef VMM_PAE
+
+/* PAE splits a virtual address 2:9:9:12. the four page directories of an
+    address space are kept next to each other, so a single index over all
+    2048 PDEs (PDPT index and directory index combined) addresses them */
+#define VMM_PAGES_PER_TABLE     512     //! 512 entries per page table
+#define VMM_PAGES_PER_DIR       2048    //! 4 directories of 512 entries each
+#define VMM_PDPT_ENTRIES        4       //! one PDPT entry per directory
+
+// get PDPT index (top 2 bits)
+#define VMM_PDPT_INDEX(addr)    (((uintptr_t)(addr) >> 30) & 0x3)
+
+// get page directory index across all four directories (top 11 bits)
+#define VMM_DIR_INDEX(addr)     (((uintptr_t)(addr) >> 21) & 0x7FF)
+
+// get page directory index within its directory (next 9 bits)
+#define VMM_PD_INDEX(addr)      (((uintptr_t)(addr) >> 21) & 0x1FF)
+
+// get page table index (next 9 bits)
+#define VMM_TABLE_INDEX(addr)   (((uintptr_t)(addr) >> 12) & 0x1FF)
+
+#else
+
 #define VMM_PAGES_PER_TABLE     1024    //! 1024 entries per page table
 #define VMM_PAGES_PER_DIR       1024    //! 1024 entries per page directory
 
@@ -37,16 +61,107 @@
 // get page table index (next 10 bits)
 #define VMM_TABLE_INDEX(addr)   (((uintptr_t)(addr) >> 12) & 0x3FF)
 
+#endif
+
+// start of the kernel half (physmap, kernel image, heap), the same in every
+// address space. mappings up here are global, user mappings never are
+#define VMM_KERNEL_BASE         PHYSMAP_BASE
+
+// first PDE of the kernel half. these PDEs are fixed once vmm_init is done
+// and every new address space starts with a copy of them
+#define VMM_KERNEL_PDE_FIRST    VMM_DIR_INDEX(VMM_KERNEL_BASE)
+
+// a large page covers what one page table would (4MB, 2MB with PAE)
+#define VMM_LARGE_PAGE_SIZE     (VMM_PAGES_PER_TABLE * VMM_PAGE_SIZE)
+
+#ifdef VMM_RECURSIVE
+
+/* the last PDEs (one, four with PAE) point back at the directories of their
+    own address space. the page tables of the loaded space then show up as
+    one array of PTEs at VMM_RECURSIVE_BASE, indexed by page number, and its
+    PDEs as the last pages of that array */
+#ifdef VMM_PAE
+#define VMM_RECURSIVE_DIRS      VMM_PDPT_ENTRIES
+#else
+#define VMM_RECURSIVE_DIRS      1
+#endif
+
+#define VMM_RECURSIVE_PDE_FIRST (VMM_PAGES_PER_DIR - VMM_RECURSIVE_DIRS)
+#define VMM_RECURSIVE_BASE      ((uintptr_t)VMM_RECURSIVE_PDE_FIRST * VMM_LARGE_PAGE_SIZE)
+
+// PTE and PDE of 'addr' in the loaded address space
+#define VMM_RECURSIVE_PTE(addr) (&((pte_t*)VMM_RECURSIVE_BASE)[(uintptr_t)(addr) / VMM_PAGE_SIZE])
+#define VMM_RECURSIVE_PDE(addr) (&((pde_t*)(VMM_RECURSIVE_BASE + VMM_RECURSIVE_PDE_FIRST * VMM_PAGE_SIZE))[VMM_DIR_INDEX(addr)])
+
+// the kernel half ends where the self-map starts, those PDEs differ per space
+#define VMM_KERNEL_PDE_END      VMM_RECURSIVE_PDE_FIRST
+
+#else
+
+#define VMM_KERNEL_PDE_END      VMM_PAGES_PER_DIR
+
+#endif
+
 // get page table offset (last 12 bits)
 #define VMM_PAGE_OFFSET(addr)   ((uintptr_t)(addr) & 0xFFF)
 
+// frames requested from kmm at once by the region and clone paths
+#define VMM_BATCH_FRAMES        64
+
+// vmm_alloc_region flag: only reserve the range, each page gets a zeroed
+// frame when it is first touched
+#define VMM_LAZY                PTE_LAZY
+
+// marks of not-present entries that still hold on to their page
+#define VMM_PTE_RESERVED        (PTE_LAZY | PTE_GUARD | PTE_SWAPPED)
+
+// reclaim starts once an allocation would leave fewer free frames than the
+// watermark, and evicts at least a batch of pages when it does
+#define VMM_RECLAIM_WATERMARK   256
+#define VMM_RECLAIM_BATCH       32
+
+// address spaces whose fault counters are kept at the same time
+#define VMM_FAULT_STAT_SLOTS    16
+
 // Page Fault Interrupt vector
 #define PAGE_FAULT_INTERRUPT (uint8_t)14
 
+// page fault error code bits
+#define VMM_PF_PRESENT          0x001   //! fault on a present page (protection)
+#define VMM_PF_WRITE            0x002   //! faulting access was a write
+#define VMM_PF_USER             0x004   //! fault happened in user mode
+
+// fault class, one per combination of the three bits above
+#define VMM_FAULT_CLASSES       8
+#define VMM_FAULT_CLASS(error)  ((error) & (VMM_PF_PRESENT | VMM_PF_WRITE | VMM_PF_USER))
+
+// fault resolvers that can be registered (lazy, cow and guard built in)
+#define VMM_FAULT_RESOLVERS_MAX 8
+
+// fault cost histogram: bucket i counts faults of 2^(i + VMM_FAULT_HIST_SHIFT)
+// cycles and up, the first and last bucket also take what is below / above
+#define VMM_FAULT_HIST_BUCKETS  16
+#define VMM_FAULT_HIST_SHIFT    8
+
+// TLB invalidations queued by one unmap: up to the threshold (tunable, at
+// most VMM_TLB_BATCH_MAX) pages get an invlpg each, past it the whole TLB
+// is flushed at once
+#define VMM_TLB_BATCH_MAX       64
+#define VMM_TLB_FLUSH_THRESHOLD 32
+
+// translations cached per address space (direct mapped by page number), and
+// address spaces with a cache at the same time
+#define VMM_XLATE_ENTRIES       64
+#define VMM_XLATE_SLOTS         8
+
+// working-set scans from the idle loop are at least this many TSC cycles apart
+#define VMM_WS_SCAN_CYCLES      (1ULL << 30)
+
 
 // 32bit PTE/PDE entry:
 // 1) 11-0 bits -> flags/control-bits
 // 2) 31-12 bits -> physical address
+// (64bit with PAE: 35-12 bits -> physical address, 63 -> no-execute)
 
 //-----------------------------------------------------------------------------
 // 		INTERFACE DATA STRUCTURES
@@ -60,6 +175,21 @@ typedef struct {
 
 } pagetable_t;
 
+#ifdef VMM_PAE
+//! represents a PAE address space: the PDPT (its own page, CR3 points here)
+//! followed by its four page directories
+typedef struct {
+
+    //! page directory pointer table, entry i points at directory i below
+    pdpte_t     pdpt[ VMM_PDPT_ENTRIES ];
+
+    uint8_t     reserved[ VMM_PAGE_SIZE - VMM_PDPT_ENTRIES * sizeof(pdpte_t) ];
+
+    //! array of page directory entries (all four directories)
+    pde_t       table[ VMM_PAGES_PER_DIR ];
+
+} pagedir_t;
+#else
 //! represents a page directory
 typedef struct {
 
@@ -67,6 +197,119 @@ typedef struct {
     pde_t       table[ VMM_PAGES_PER_DIR ];
 
 } pagedir_t;
+#endif
+
+//! page faults resolved (or not) in one address space
+typedef struct {
+
+    //! reserved (VMM_LAZY) pages backed on first touch
+    uint32_t    lazy_faults;
+
+    //! of those, reads mapped to the shared zero frame
+    uint32_t    zero_page_faults;
+
+    //! writes to copy-on-write pages
+    uint32_t    cow_faults;
+
+    //! guard pages touched (and moved down, within their stack VMA)
+    uint32_t    guard_faults;
+
+    //! pages read back from swap
+    uint32_t    swap_faults;
+
+    //! faults nothing could resolve
+    uint32_t    unresolved_faults;
+
+} vmm_fault_stats_t;
+
+//! page faults of the whole system
+typedef struct {
+
+    //! faults taken
+    uint32_t    faults;
+
+    //! faults by class (VMM_FAULT_CLASS of the error code)
+    uint32_t    class_faults[ VMM_FAULT_CLASSES ];
+
+    //! faults taken by each resolver, in registration order
+    uint32_t    resolved[ VMM_FAULT_RESOLVERS_MAX ];
+
+    //! faults no resolver took
+    uint32_t    unresolved;
+
+    //! cycles spent on resolved faults, power-of-two buckets
+    uint32_t    cycle_hist[ VMM_FAULT_HIST_BUCKETS ];
+
+} vmm_fault_summary_t;
+
+//! pages whose mappings changed, invalidated together by vmm_tlb_batch_flush
+typedef struct {
+
+    //! address space the pages belong to
+    pagedir_t*  pdir;
+
+    //! pages queued, may go past VMM_TLB_BATCH_MAX (only the first are kept)
+    uint32_t    count;
+
+    //! a kernel-half page is queued, those can be global
+    bool        kernel;
+
+    uintptr_t   pages[ VMM_TLB_BATCH_MAX ];
+
+} vmm_tlb_batch_t;
+
+//! translation cache use of the whole system
+typedef struct {
+
+    //! vmm_get_phys_addr calls
+    uint32_t    lookups;
+
+    //! answered from the cache
+    uint32_t    hits;
+
+} vmm_xlate_stats_t;
+
+//! pages sent to swap by reclaim and faulted back in, with their cost
+typedef struct {
+
+    uint32_t    evictions;
+    uint32_t    swap_ins;
+
+    //! TSC cycles spent, in total
+    uint64_t    evict_cycles;
+    uint64_t    swap_in_cycles;
+
+} vmm_swap_stats_t;
+
+//! a physically contiguous piece of a virtual buffer
+typedef struct {
+
+    phys_addr_t phys;
+    uint32_t    size;
+
+} vmm_extent_t;
+
+//! working set of one address space, as of its last scan. only the pages of
+//! its VMAs are counted
+typedef struct {
+
+    //! scans so far
+    uint32_t    scans;
+
+    //! present pages with a frame of their own (resident set)
+    uint32_t    resident;
+
+    //! of those, accessed since the scan before (working set)
+    uint32_t    working_set;
+
+    //! of those, written since they were mapped
+    uint32_t    dirty;
+
+} vmm_ws_stats_t;
+
+//! resolves a fault at 'virtual' in 'pdir', returns true when the access can
+//! be retried. 'error_code' is the one pushed by the CPU
+typedef bool (*vmm_fault_resolver_t)(pagedir_t* pdir, uintptr_t virtual, uint32_t error_code);
 
 //-----------------------------------------------------------------------------
 // 		INTERFACE FUNCTION PROTOTYPES
@@ -76,20 +319,51 @@ void _vmm_page_fault_handler(interrupt_context_t* ctx);
 pagedir_t* vmm_create_address_space(void);
 void vmm_create_pt(pagedir_t* pdir, void* virtual, uint32_t flags);
 void vmm_map_page(pagedir_t* pdir, void* virtual, void* physical, uint32_t flags);
+void vmm_map_page_phys(pagedir_t* pdir, void* virtual, phys_addr_t physical, uint32_t flags);
+bool vmm_map_large_page(pagedir_t* pdir, void* virtual, phys_addr_t physical, uint32_t flags);
+bool vmm_map_range(pagedir_t* pdir, void* virtual, phys_addr_t physical, size_t size, uint32_t flags);
+bool vmm_unmap_range(pagedir_t* pdir, void* virtual, size_t size);
 pagedir_t* vmm_get_kerneldir(void);
 pagedir_t* vmm_get_current_pagedir(void);
 void* vmm_get_phys_frame(pagedir_t* pdir, void* virtual);
+phys_addr_t vmm_get_phys_addr(pagedir_t* pdir, void* virtual);
+uint32_t vmm_translate_range(pagedir_t* pdir, void* virtual, size_t size, vmm_extent_t* extents, uint32_t max_extents);
+void vmm_get_xlate_stats(vmm_xlate_stats_t* stats);
 int32_t vmm_page_alloc(pte_t* pte, uint32_t flags);
 void vmm_page_free(pte_t* pte);
 bool vmm_alloc_region(pagedir_t* pdir, void* virtual, size_t size, uint32_t flags);
 bool vmm_free_region(pagedir_t* pdir, void* virtual, size_t size);
 pagetable_t* vmm_clone_pagetable(pagetable_t* src);
 pagedir_t* vmm_clone_pagedir(void);
+pagedir_t* vmm_clone_pagedir_cow(void);
+void vmm_get_fault_stats(pagedir_t* pdir, vmm_fault_stats_t* stats);
+int32_t vmm_register_fault_resolver(const char* name, vmm_fault_resolver_t resolver);
+const char* vmm_fault_resolver_name(uint32_t index);
+const char* vmm_fault_class_name(uint32_t fault_class);
+void vmm_get_fault_summary(vmm_fault_summary_t* summary);
+void vmm_print_fault_stats(void);
+bool vmm_set_guard_page(pagedir_t* pdir, void* virtual, void* limit, uint32_t flags);
+void vmm_tlb_batch_init(vmm_tlb_batch_t* batch, pagedir_t* pdir);
+void vmm_tlb_batch_add(vmm_tlb_batch_t* batch, void* virtual);
+void vmm_tlb_batch_flush(vmm_tlb_batch_t* batch);
+void vmm_set_tlb_flush_threshold(uint32_t pages);
+uint32_t vmm_get_tlb_flush_threshold(void);
+void vmm_ws_scan(pagedir_t* pdir);
+bool vmm_ws_scan_idle(void);
+bool vmm_get_ws_stats(pagedir_t* pdir, vmm_ws_stats_t* stats);
+uint32_t vmm_reclaim(uint32_t pages);
+uint32_t vmm_reclaim_space(pagedir_t* pdir, uint32_t pages);
+void vmm_set_reclaim_watermark(uint32_t frames);
+void vmm_get_swap_stats(vmm_swap_stats_t* stats);
 
 
 // helpers
 bool vmm_switch_pagedir(pagedir_t* pagedir);
 void vmm_read_cr3(void);
+uint64_t vmm_get_boot_map_cycles(void);
+bool vmm_pae_enabled(void);
+bool vmm_pse_enabled(void);
+bool vmm_pge_enabled(void);
 static inline void flush_tlb(void* virt);
 
 //*****************************************************************************
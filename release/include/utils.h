@@ -158,6 +158,14 @@ static inline void sti(void) {
 }
 
 
+//! reads the 64-bit time-stamp counter (cycles since reset)
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+
 //! macro to get esp value into specified var
 #define GET_ESP(var) \
     asm volatile ("mov %%esp, %0" : "=r"(var))
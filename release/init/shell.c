@@ -15,14 +15,26 @@ dispatch_entry_t cmd_dispatch_table[NUM_CMD] =
     {"color", color_cmd, "(Add available text colors!) color [name] | Change text color.\n"},
     {"bgcolor", bg_color_cmd, "(Add available colors!) bgcolor [name] | Changes background color.\n"},
     {"repeat", repeat_text_cmd, "repeat [n] [text] | Display text n times.\n"},
-    {"exit", exit_cmd, "exit | Exit shell.\n"}
+    {"exit", exit_cmd, "exit | Exit shell.\n"},
+    {"meminfo", meminfo_cmd, "meminfo | Display frame usage, zero pool and swap statistics.\n"},
+    {"faultinfo", faultinfo_cmd, "faultinfo | Display page fault counts by class and resolver, and their cycle costs.\n"},
+    {"wsinfo", wsinfo_cmd, "wsinfo | Display the resident set and working set of this address space.\n"}
 };
 
+// idle time goes to the zero pool first, then to the working-set scanner
+static bool shell_idle(void)
+{
+    return kmm_zero_pool_refill() || vmm_ws_scan_idle();
+}
+
 void shell(void)
 {
     // just to be safe
     // clear();
 
+    // pre-zero frames and sample working sets while waiting for input
+    kbd_set_idle_handler(shell_idle);
+
     while (shell_active)
     {
         if (shell_active == false)
@@ -323,5 +335,63 @@ void exit_cmd(char* args)
     return;
 }
 
+void meminfo_cmd(char* args)
+{
+    kmm_zero_pool_stats_t stats;
+    kmm_get_zero_pool_stats(&stats);
+
+    uint32_t total = kmm_get_total_frames();
+    uint32_t used = kmm_get_used_frames();
+
+    printf("frames: %u total, %u used, %u free\n", total, used, total - used);
+    printf("zero pool: %u frames, %u hits, %u misses\n", stats.pooled, stats.hits, stats.misses);
+
+    static const char* zone_names[KMM_ZONE_COUNT] = { "DMA", "NORMAL", "HIGH" };
+
+    for (uint32_t zone = 0; zone < KMM_ZONE_COUNT; zone++)
+    {
+        kmm_zone_stats_t zone_stats;
+        kmm_get_zone_stats(zone, &zone_stats);
+
+        printf("zone %s: %u frames, %u free\n", zone_names[zone], zone_stats.end - zone_stats.start, zone_stats.free);
+    }
+
+    swap_stats_t swap;
+    swap_get_stats(&swap);
+
+    vmm_swap_stats_t swap_stats;
+    vmm_get_swap_stats(&swap_stats);
+
+    printf("swap: %u slots, %u used, %u evictions (%llu cycles), %u swap-ins (%llu cycles)\n",
+           swap.slots, swap.used, swap_stats.evictions, swap_stats.evict_cycles,
+           swap_stats.swap_ins, swap_stats.swap_in_cycles);
+}
+
+void faultinfo_cmd(char* args)
+{
+    vmm_print_fault_stats();
+
+    vmm_fault_stats_t stats;
+    vmm_get_fault_stats(vmm_get_current_pagedir(), &stats);
+
+    printf("this address space: %u lazy (%u zero page), %u cow, %u guard, %u swap, %u unresolved\n",
+           stats.lazy_faults, stats.zero_page_faults, stats.cow_faults, stats.guard_faults,
+           stats.swap_faults, stats.unresolved_faults);
+}
+
+void wsinfo_cmd(char* args)
+{
+    vmm_ws_stats_t stats;
+
+    if (!vmm_get_ws_stats(vmm_get_current_pagedir(), &stats))
+    {
+        printf("no regions in this address space\n");
+        return;
+    }
+
+    printf("resident: %u pages, working set: %u pages, dirty: %u pages (%u scans)\n",
+           stats.resident, stats.working_set, stats.dirty, stats.scans);
+}
+
 
 #endif
\ No newline at end of file
@@ -91,7 +91,8 @@ void kheap_init(heap_t *heap, void *start, size_t size, size_t max_size, bool is
     if (!map_pdir)
         map_pdir = vmm_get_current_pagedir();
 
-    uint32_t map_flags = PTE_PRESENT | PTE_WRITABLE;
+    // reserved only, pages get their frames when the allocator first touches them
+    uint32_t map_flags = PTE_PRESENT | PTE_WRITABLE | VMM_LAZY;
 
     // check for user
     if (!is_supervisor)
@@ -104,7 +105,6 @@ void kheap_init(heap_t *heap, void *start, size_t size, size_t max_size, bool is
     if (!alloc)
         return;    // zaleel
 
-
     // vibes
     /* seed the free-lists with a single root free block covering the managed region */
     free_block_hdr *root = (free_block_hdr*) (st->base);
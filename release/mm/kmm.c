@@ -13,417 +13,1770 @@ static e820_entry_t* mem_map;
 static uint32_t* bitmap;
 static uint32_t bitmap_size = 0;
 
+// summary levels over the bitmap: a set bit means the word below is full
+static uint32_t* bitmap_summary;            // one bit per bitmap word
+static uint32_t bitmap_summary_size = 0;
+static uint32_t* bitmap_summary_top;        // one bit per summary word
+static uint32_t bitmap_summary_top_size = 0;
+
 // status variables (for debugging)
 static uint32_t free_frames;
 static uint32_t used_frames;
 
+// TSC cycles spent in the last kmm_init
+static uint64_t init_cycles = 0;
 
-// helpers
-void kmm_get_available_mem()
+// one descriptor per frame, placed after the bitmap (and the free areas)
+static frame_desc_t* frame_descs;
+static uint32_t frame_desc_count = 0;
+
+// immutable reserved ranges (in frames), sorted and non-overlapping
+typedef struct
 {
-    // BIOS dumps memory size onto MEM_SIZE_LOC -> read this in
-    e801_memsize_t* mem_size = (e801_memsize_t*) MEM_SIZE_LOC;
+    uint32_t start;
+    uint32_t end;           // exclusive
+
+} kmm_range_t;
+
+static kmm_range_t reserved_ranges[KMM_MAX_RESERVED_RANGES];
+static uint32_t reserved_range_count = 0;
+
+// zeroed frames (physical addresses) ready to be handed out, the pool holds
+// them as used frames
+static void* zero_pool[KMM_ZERO_POOL_SIZE];
+static uint32_t zero_pool_count = 0;
+static uint32_t zero_pool_hits = 0;
+static uint32_t zero_pool_misses = 0;
+
+// asked for frames when free ones run low, never from inside itself
+static kmm_reclaim_handler_t reclaim_handler = NULL;
+static uint32_t reclaim_watermark = 0;
+static bool reclaim_running = false;
+
+// zone boundaries (zone i covers [zone_end[i - 1], zone_end[i])) and free
+// frames per zone. boundaries are multiples of the largest buddy block, so a
+// bitmap word or a buddy block never spans two zones
+static uint32_t zone_end[KMM_ZONE_COUNT];
+static uint32_t zone_free[KMM_ZONE_COUNT];
+
+#ifdef KMM_BUDDY
+// buddy free areas, one per order. a set bit marks the first frame of a free
+// block of that order (block number = frame >> order). the bitmap above stays
+// the authority on which frames are used, the free areas only index the free
+// frames by block size. each area has the same summary levels as the bitmap,
+// except that a set summary bit means the word below is non-zero
+typedef struct
+{
+    uint32_t* bits;
+    uint32_t* summary;
+    uint32_t* top;
+    uint32_t size;
+    uint32_t summary_size;
+    uint32_t top_size;
+    uint32_t blocks;            // number of whole blocks of this order
+    uint32_t free_blocks;
 
-    // calculate and return available memory (in KB)
-    available_size = AVLBL_MEM(mem_size->memLow, mem_size->memHigh);
+} kmm_free_area_t;
+
+static kmm_free_area_t free_area[KMM_BUDDY_MAX_ORDER + 1];
+static uint32_t free_area_bytes = 0;
+#endif
+
+
+// bitmap helpers (keep the summary levels in sync with the bitmap)
+static inline bool _kmm_bitmap_test(uint32_t frame)
+{
+    return (bitmap[frame / 32] & (1u << (frame % 32))) != 0;
 }
 
-void kmm_get_physical_mem_map()
+static inline uint32_t _kmm_zone_of(uint32_t frame)
 {
-    // BIOS dumps the array onto MEM_MAP_LOC -> read it in
-    mem_map_entries_count = *(uint32_t*) MEM_MAP_ENTRY_COUNT_LOC;
-    mem_map = (e820_entry_t*) MEM_MAP_LOC;
+    if (frame < zone_end[KMM_ZONE_DMA])
+        return KMM_ZONE_DMA;
+
+    if (frame < zone_end[KMM_ZONE_NORMAL])
+        return KMM_ZONE_NORMAL;
+
+    return KMM_ZONE_HIGH;
 }
 
-void kmm_print_status(void)
+static inline uint32_t _kmm_zone_start(uint32_t zone)
 {
-    LOG_DEBUG("Total memory: %u KB\n", available_size);
-    LOG_DEBUG("Used frames: %u\n", used_frames);
-    LOG_DEBUG("Free frames: %u\n", free_frames);
-    
+    return (zone == 0) ? 0 : zone_end[zone - 1];
 }
 
-bitmap_frame_info_t kmm_get_first_free_bit(void)
+// mask of 'span' bits starting at 'bit' within a 32-bit word
+static inline uint32_t _kmm_bitmap_mask(uint32_t bit, uint32_t span)
 {
-    // a bit naive, but oh well...
-    bitmap_frame_info_t free_frame_info;
+    if (span >= 32)
+        return (uint32_t)0xFFFFFFFF;
 
-    // set with sentinel values
-    free_frame_info.index = (uint32_t) 0xFFFFFFFF;
-    free_frame_info.offset = (uint32_t) 0xFFFFFFFF;
+    return ((1u << span) - 1) << bit;
+}
 
-    uint32_t total_frames = kmm_get_total_frames();
+// number of set bits in a word (no libgcc to provide __popcountsi2)
+static inline uint32_t _kmm_popcount(uint32_t word)
+{
+    word = word - ((word >> 1) & 0x55555555);
+    word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+    word = (word + (word >> 4)) & 0x0F0F0F0F;
 
-    // search bitmap for first free bit -> linear search? -> may go binary search later
-    for (uint32_t i = 0; i < bitmap_size; i++)
-    {
-        // iterate through each 32-bit field
-        uint32_t field = bitmap[i];
+    return (word * 0x01010101) >> 24;
+}
 
-        // check if this field is fully set
-        if (field == (uint32_t)0xFFFFFFFF)
-            continue;
+static inline void _kmm_bitmap_word_set(uint32_t index, uint32_t mask)
+{
+    zone_free[_kmm_zone_of(index * 32)] -= _kmm_popcount(~bitmap[index] & mask);
 
-        // check each bit
-        for (uint32_t bit_i = 0; bit_i < 32; bit_i++)
-        {
-            uint32_t frame = i * 32u + bit_i;
+    bitmap[index] |= mask;
 
-            // check if bit_i is valid (RECHECK)
-            if (frame >= (total_frames))
-                break;
+    // word just became full -> propagate upwards
+    if (bitmap[index] == (uint32_t)0xFFFFFFFF)
+    {
+        uint32_t summary_i = index / 32;
 
-            // check if bit is set
-            if ((field & (1u << bit_i)) == 0)
-            {
-                // free frame
-                free_frame_info.index = i;
-                free_frame_info.offset = bit_i;
+        bitmap_summary[summary_i] |= (1u << (index % 32));
 
-                return free_frame_info;
-            }
-        }
+        if (bitmap_summary[summary_i] == (uint32_t)0xFFFFFFFF)
+            bitmap_summary_top[summary_i / 32] |= (1u << (summary_i % 32));
     }
-
-    // no free frames
-    return free_frame_info;
 }
 
-
-// API definitions
-uint32_t kmm_get_total_frames(void)
+static inline void _kmm_bitmap_word_clear(uint32_t index, uint32_t mask)
 {
-    return (used_frames + free_frames);
+    uint32_t summary_i = index / 32;
+
+    zone_free[_kmm_zone_of(index * 32)] += _kmm_popcount(bitmap[index] & mask);
+
+    bitmap[index] &= ~mask;
+
+    // a word with a free bit can never be full, same for its summary word
+    bitmap_summary[summary_i] &= ~(1u << (index % 32));
+    bitmap_summary_top[summary_i / 32] &= ~(1u << (summary_i % 32));
 }
 
-uint32_t kmm_get_used_frames(void)
+static inline void _kmm_bitmap_set(uint32_t frame)
 {
-    return used_frames;
+    _kmm_bitmap_word_set(frame / 32, 1u << (frame % 32));
 }
 
-void kmm_init(void)
+static inline void _kmm_bitmap_clear(uint32_t frame)
 {
-    LOG_DEBUG("------------------------------\n");
-    LOG_DEBUG("KMM INIT\n");
+    _kmm_bitmap_word_clear(frame / 32, 1u << (frame % 32));
+}
 
-    kmm_get_available_mem();
-    kmm_get_physical_mem_map();
+// marks [frame, frame + count) used a word at a time, returns how many
+// frames were previously free
+static uint32_t _kmm_bitmap_set_range(uint32_t frame, uint32_t count)
+{
+    uint32_t end = frame + count;
+    uint32_t changed = 0;
 
-    // get physical addressesof kernel start and end
-    uint32_t kstart_addr = (uint32_t) VIRT_TO_PHYS(&kernel_start);
-    uint32_t kend_addr = (uint32_t) VIRT_TO_PHYS(&kernel_end);
+    while (frame < end)
+    {
+        uint32_t bit = frame % 32;
+        uint32_t span = (end - frame < 32 - bit) ? (end - frame) : (32 - bit);
+        uint32_t mask = _kmm_bitmap_mask(bit, span);
 
-    // calculate bitmap_size (with ceil) -> this is the number of 32bit entries required
-    uint32_t pageframe_total = (available_size * 1024) / _KMM_BLOCK_SIZE;
+        changed += _kmm_popcount(~bitmap[frame / 32] & mask);
+        _kmm_bitmap_word_set(frame / 32, mask);
 
-    // set number of frames (total number of bits)
-    used_frames = pageframe_total;
-    free_frames = 0;
-    
-    bitmap_size = (pageframe_total + 31) / 32;
+        frame += span;
+    }
 
-    // compute start-of-bitmap address (aligned)
-    uint32_t bitmap_start_addr = (uint32_t) ALIGN(kend_addr, _KMM_BLOCK_ALIGNMENT);
-    
-    // compute end-of-bitmap address (unaligned)
-    uint32_t bitmap_end_addr = bitmap_start_addr + (bitmap_size * sizeof(uint32_t));
+    return changed;
+}
 
-    // ensure the bitmap end is block-aligned so reservation covers full frames
-    bitmap_end_addr = (uint32_t) ALIGN(bitmap_end_addr, _KMM_BLOCK_ALIGNMENT);
+// marks [frame, frame + count) free a word at a time, returns how many
+// frames were previously used
+static uint32_t _kmm_bitmap_clear_range(uint32_t frame, uint32_t count)
+{
+    uint32_t end = frame + count;
+    uint32_t changed = 0;
 
-    // place bitmap right after kernel code and data (kernel_end)
-    bitmap = (uint32_t*) PHYS_TO_VIRT(bitmap_start_addr);
+    while (frame < end)
+    {
+        uint32_t bit = frame % 32;
+        uint32_t span = (end - frame < 32 - bit) ? (end - frame) : (32 - bit);
+        uint32_t mask = _kmm_bitmap_mask(bit, span);
 
-    // initialise bitmap
-    // total space occupied (in bytes)
-    memset(bitmap, (uint8_t)0xFF, bitmap_size * sizeof(uint32_t));
+        changed += _kmm_popcount(bitmap[frame / 32] & mask);
+        _kmm_bitmap_word_clear(frame / 32, mask);
 
+        frame += span;
+    }
 
+    return changed;
+}
 
-    // iterate through the mem_map
-    for (uint32_t i = 0; i < mem_map_entries_count; i++)
-    {
-        // get current region
-        e820_entry_t* region = &mem_map[i];
+// first free frame at or after 'frame' (or _KMM_INVALID_FRAME). only the
+// words on the way up and down the summary levels are read. padding bits past
+// the last frame are always set so they are never returned.
+static uint32_t _kmm_find_free_from(uint32_t frame)
+{
+    uint32_t index = frame / 32;
 
-        // skip if unusable
-        if (region->type != 1)
-            continue;
+    if (index >= bitmap_size)
+        return _KMM_INVALID_FRAME;
 
-        // get base and lengths
-        uint32_t base_low = region->baseLow;
-        uint32_t base_high = region->baseHigh;
-        uint32_t length_low = region->lengthLow;
-        uint32_t length_high = region->lengthHigh;
+    // rest of the current bitmap word
+    uint32_t bits = ~bitmap[index] & ((uint32_t)0xFFFFFFFF << (frame % 32));
 
-        // get region type
-        uint32_t type = region->type;
+    if (bits)
+        return (index * 32) + (uint32_t)__builtin_ctz(bits);
 
-        // merge base and lengths into a 64-bit field
-        uint64_t base_addr = ((uint64_t)base_high << 32) | ((uint64_t)base_low);
-        uint64_t length = ((uint64_t)length_high << 32) | ((uint64_t)length_low);
+    // next bitmap word that is not full, from the rest of its summary word
+    uint32_t next = index + 1;
+    uint32_t summary_i = next / 32;
 
-        // compute start and end points of the region, rounding up and down for alighment
-        uint64_t region_start = (uint64_t)ALIGN(base_addr, _KMM_BLOCK_ALIGNMENT);
-        uint64_t region_end = (uint64_t)ALIGN(base_addr + length, _KMM_BLOCK_ALIGNMENT);
+    if (summary_i >= bitmap_summary_size)
+        return _KMM_INVALID_FRAME;
 
-        // from the endpoints, get the starting and ending frame number
-        uint32_t starting_frame = (region_start) / (_KMM_BLOCK_SIZE);
-        uint32_t ending_frame = (region_end) / (_KMM_BLOCK_SIZE);
+    bits = ~bitmap_summary[summary_i] & ((uint32_t)0xFFFFFFFF << (next % 32));
 
-        // iterate over each frame region, conditionally setting each frame bit
-        for (uint32_t frame = starting_frame; frame < ending_frame; frame++)
-        {
-            // I need some sort of index to access a specific 32-bit enty in the bitmap
-            uint32_t index = (frame) / (32);
+    if (!bits)
+    {
+        // next summary word that is not full, from the top level
+        next = summary_i + 1;
+        uint32_t top_i = next / 32;
 
-            // I also need an offset to access the particular bit
-            uint32_t offset = (frame) % 32;
+        if (top_i >= bitmap_summary_top_size)
+            return _KMM_INVALID_FRAME;
 
-            // mark as free
-            bitmap[index] &= ~(1u << offset);
+        bits = ~bitmap_summary_top[top_i] & ((uint32_t)0xFFFFFFFF << (next % 32));
 
-            // increment free count
-            free_frames += 1;
+        while (!bits)
+        {
+            if (++top_i >= bitmap_summary_top_size)
+                return _KMM_INVALID_FRAME;
 
-            // decrement used count
-            used_frames -= 1;
+            bits = ~bitmap_summary_top[top_i];
         }
 
+        summary_i = (top_i * 32) + (uint32_t)__builtin_ctz(bits);
+        bits = ~bitmap_summary[summary_i];
     }
 
+    index = (summary_i * 32) + (uint32_t)__builtin_ctz(bits);
 
-    // reserve low memory regions (640KiB instead of till 1MB for ... reasons ...)
-    kmm_setup_memory_region(0x00000000, 0x000A0000, true);
-
+    return (index * 32) + (uint32_t)__builtin_ctz(~bitmap[index]);
+}
 
-    // reserve kernel frames
-    uint32_t kernel_start_frame = (uint32_t)ALIGN(kstart_addr, _KMM_BLOCK_ALIGNMENT);
-    kernel_start_frame /= _KMM_BLOCK_SIZE;
+// first used frame in [frame, frame + count) (or _KMM_INVALID_FRAME)
+static uint32_t _kmm_find_used_in_range(uint32_t frame, uint32_t count)
+{
+    uint32_t end = frame + count;
 
-    uint32_t kernel_end_frame = (uint32_t)ALIGN(kend_addr, _KMM_BLOCK_ALIGNMENT);
-    kernel_end_frame /= _KMM_BLOCK_SIZE;
-    
-    for (uint32_t frame = kernel_start_frame; frame < kernel_end_frame; frame++)
+    while (frame < end)
     {
-        uint32_t index = frame / 32;
-        uint32_t offset = frame % 32;
-        
-        // only reserve if currently marked free (avoid double-counting)
-        if ((bitmap[index] & (1u << offset)) == 0)
-        {
-            // mark as used
-            bitmap[index] |= (1u << offset);
+        uint32_t bit = frame % 32;
+        uint32_t span = (end - frame < 32 - bit) ? (end - frame) : (32 - bit);
+        uint32_t used = bitmap[frame / 32] & _kmm_bitmap_mask(bit, span);
 
-            free_frames -= 1;
-            used_frames += 1;
-        }
-    }
-    
-    // reserve bitmap frames
-    uint32_t bitmap_start_frame = bitmap_start_addr / _KMM_BLOCK_SIZE;
-    uint32_t bitmap_end_frame = bitmap_end_addr / _KMM_BLOCK_SIZE;
-    
-    for (uint32_t frame = bitmap_start_frame; frame < bitmap_end_frame; frame++)
-    {
-        uint32_t index = frame / 32;
-        uint32_t offset = frame % 32;
-        
-        // only reserve if currently marked free (avoid double-counting)
-        if ((bitmap[index] & (1u << offset)) == 0)
-        {
-            // mark as used
-            bitmap[index] |= (1u << offset);
+        if (used)
+            return ((frame / 32) * 32) + (uint32_t)__builtin_ctz(used);
 
-            free_frames -= 1;
-            used_frames += 1;
-        }
+        frame += span;
     }
 
-    // reserve frame 0
-    if ((bitmap[0] & 0x1u) == 0) 
-    {  
-        // mark as used
-        bitmap[0] |= 0x1u;
-        
-        free_frames -= 1;
-        used_frames += 1;
-    }
+    return _KMM_INVALID_FRAME;
+}
 
+// total bytes used by the kmm metadata placed after the kernel: the bitmap,
+// its summary levels, the buddy free areas and the frame descriptors
+static inline uint32_t _kmm_metadata_bytes(void)
+{
+    uint32_t bytes = (bitmap_size + bitmap_summary_size + bitmap_summary_top_size) * sizeof(uint32_t);
 
-    // TODO: print debug info
-    kmm_print_status();
+#ifdef KMM_BUDDY
+    bytes += free_area_bytes;
+#endif
+
+    bytes += frame_desc_count * sizeof(frame_desc_t);
+
+    return bytes;
 }
 
-void kmm_setup_memory_region(uint32_t base, uint32_t size, bool is_reserved)
+
+// records [start_frame, end_frame) in the reserved-range table, keeping it
+// sorted by start frame and merging overlapping or touching ranges
+static void _kmm_reserved_add(uint32_t start_frame, uint32_t end_frame)
 {
-    // don't modify the boot/reserved low-memory area when clearing regions
-    // const uint32_t reserved_end = 0x100000;
+    if (start_frame >= end_frame)
+        return;
 
-    // if (!is_reserved)
-    // {
-    //     // If the entire region lies below reserved_end, nothing to do
-    //     if ((uint64_t)base + (uint64_t)size <= (uint64_t)reserved_end)
-    //         return;
+    // find the insertion point
+    uint32_t i = 0;
 
-    //     // If region partially overlaps reserved area, adjust to skip the reserved portion
-    //     if (base < reserved_end)
-    //     {
-    //         uint32_t overlap = reserved_end - base;
-    //         base += overlap;
-    //         size -= overlap;
-    //     }
-    // }
+    while (i < reserved_range_count && reserved_ranges[i].start < start_frame)
+        i++;
 
-    // convert offsets into a physical region
-    uint64_t region_start = (uint64_t)ALIGN(base, _KMM_BLOCK_ALIGNMENT);
-    uint64_t region_end = (uint64_t)ALIGN(base + size, _KMM_BLOCK_ALIGNMENT);
+    // merge with the previous range if they touch
+    if (i > 0 && reserved_ranges[i - 1].end >= start_frame)
+    {
+        i--;
 
-    uint32_t starting_frame = (region_start) / (_KMM_BLOCK_SIZE);
-    uint32_t ending_frame = (region_end) / (_KMM_BLOCK_SIZE);
+        if (end_frame > reserved_ranges[i].end)
+            reserved_ranges[i].end = end_frame;
+    }
 
-    for (uint32_t frame = starting_frame; frame < ending_frame; frame++)
+    else
     {
-        uint32_t index = (frame) / (32);
-        uint32_t offset = (frame) % (32);
-
-        // conditionally set frames
-        if (is_reserved)
+        if (reserved_range_count == KMM_MAX_RESERVED_RANGES)
         {
-            // only mark if currently free
-            if ((bitmap[index] & (1u << offset)) == 0) 
-            {
-                bitmap[index] |= (1 << offset);
-                free_frames -= 1;
-                used_frames += 1;
-            }
+            LOG_ERROR("kmm: reserved-range table full, range %u-%u not protected\n", start_frame, end_frame);
+            return;
         }
 
-        else
-        {
-            // only free if currently used
-            if ((bitmap[index] & (1u << offset)) != 0) 
-            {
-                bitmap[index] &= ~(1 << offset);
-                free_frames += 1;
-                used_frames -= 1;
-            }
-        }
+        // shift the tail up
+        for (uint32_t j = reserved_range_count; j > i; j--)
+            reserved_ranges[j] = reserved_ranges[j - 1];
 
+        reserved_ranges[i].start = start_frame;
+        reserved_ranges[i].end = end_frame;
+        reserved_range_count += 1;
     }
 
+    // swallow the following ranges the (grown) range now reaches
+    while (i + 1 < reserved_range_count && reserved_ranges[i + 1].start <= reserved_ranges[i].end)
+    {
+        if (reserved_ranges[i + 1].end > reserved_ranges[i].end)
+            reserved_ranges[i].end = reserved_ranges[i + 1].end;
+
+        for (uint32_t j = i + 1; j + 1 < reserved_range_count; j++)
+            reserved_ranges[j] = reserved_ranges[j + 1];
+
+        reserved_range_count -= 1;
+    }
 }
 
-void* kmm_frame_alloc(void)
+// checks whether any frame in [start_frame, end_frame) belongs to a region
+// that must never be freed (frame 0, low memory, kernel image, kmm metadata,
+// memory map holes). single frames use the descriptor bit instead
+static bool _kmm_range_is_protected(uint32_t start_frame, uint32_t end_frame)
 {
-    // find first free frame
-    bitmap_frame_info_t free_frame_info = kmm_get_first_free_bit();
+    // table is sorted, stop at the first range past the end
+    for (uint32_t i = 0; i < reserved_range_count; i++)
+    {
+        if (reserved_ranges[i].start >= end_frame)
+            break;
 
-    // no free frames
-    if (free_frame_info.index == (uint32_t) 0xFFFFFFFF)
-        return NULL;
+        if (reserved_ranges[i].end > start_frame)
+            return true;
+    }
 
-    uint32_t frame_number = (free_frame_info.index * 32u) + free_frame_info.offset;
+    return false;
+}
 
-    // // never return frame 0; if encountered, reserve it and continue searching
-    // if (frame_number == 0)
-    // {
-    //     // mark as used if not already
-    //     if ((bitmap[free_frame_info.index] & (1u << free_frame_info.offset)) == 0) 
-    //     {
-    //         bitmap[free_frame_info.index] |= (1u << free_frame_info.offset);
-    //         used_frames += 1;
-    //         free_frames -= 1;
-    //     }
-    // }
+#ifdef KMM_BUDDY
+// buddy free area helpers
+static inline bool _kmm_area_test(kmm_free_area_t* area, uint32_t block)
+{
+    return (area->bits[block / 32] & (1u << (block % 32))) != 0;
+}
 
-    // mark that frame as used
-    bitmap[free_frame_info.index] |= (1u << free_frame_info.offset);
+static inline void _kmm_area_set(kmm_free_area_t* area, uint32_t block)
+{
+    uint32_t index = block / 32;
+    uint32_t summary_i = index / 32;
 
-    // update the usage counter
-    used_frames += 1;
+    area->bits[index] |= (1u << (block % 32));
+    area->summary[summary_i] |= (1u << (index % 32));
+    area->top[summary_i / 32] |= (1u << (summary_i % 32));
 
-    // update the free counter
-    free_frames -= 1;
-        
-    // translate frame_number to physical address
-    void* physical_addr = (void*) (frame_number * _KMM_BLOCK_SIZE);
+    area->free_blocks += 1;
+}
+
+static inline void _kmm_area_clear(kmm_free_area_t* area, uint32_t block)
+{
+    uint32_t index = block / 32;
+    uint32_t summary_i = index / 32;
 
-    return physical_addr;
+    area->bits[index] &= ~(1u << (block % 32));
 
-}   
+    // word just became empty -> propagate upwards
+    if (area->bits[index] == 0)
+    {
+        area->summary[summary_i] &= ~(1u << (index % 32));
 
-void kmm_frame_free(void* phys_addr)
+        if (area->summary[summary_i] == 0)
+            area->top[summary_i / 32] &= ~(1u << (summary_i % 32));
+    }
+
+    area->free_blocks -= 1;
+}
+
+// first free block of an area at or after 'block' (or _KMM_INVALID_FRAME),
+// same walk as _kmm_find_free_from with the levels tracking non-empty words
+static uint32_t _kmm_area_find_from(kmm_free_area_t* area, uint32_t block)
 {
-    // validate physical address
-    if (phys_addr == NULL)
-        return;
+    uint32_t index = block / 32;
 
-    uint32_t addr = (uint32_t) phys_addr;
-    uint32_t total_frames = kmm_get_total_frames();
+    if (area->free_blocks == 0 || index >= area->size)
+        return _KMM_INVALID_FRAME;
 
-    // check if physical address is page aligned
-    if ((addr % _KMM_BLOCK_ALIGNMENT) != 0)
-        return;
+    // rest of the current word
+    uint32_t bits = area->bits[index] & ((uint32_t)0xFFFFFFFF << (block % 32));
 
-    // convert to frame index
-    uint32_t frame_number = addr / (_KMM_BLOCK_SIZE);
+    if (bits)
+        return (index * 32) + (uint32_t)__builtin_ctz(bits);
 
-    // validate frame index
-    if (frame_number >= total_frames)
-        return;
+    // next non-empty word, from the rest of its summary word
+    uint32_t next = index + 1;
+    uint32_t summary_i = next / 32;
 
-    // check if frame 0 is being accessed
-    if (frame_number == 0)
-        return;
+    if (summary_i >= area->summary_size)
+        return _KMM_INVALID_FRAME;
 
-    // check (not reserved, bitmap, kernel region)
-    uint32_t reserved_end = 0x100000;
-    uint32_t reserved_end_frame = (reserved_end) / (_KMM_BLOCK_SIZE);
+    bits = area->summary[summary_i] & ((uint32_t)0xFFFFFFFF << (next % 32));
 
-    if (frame_number < reserved_end_frame)
-        return;
+    if (!bits)
+    {
+        // next non-empty summary word, from the top level
+        next = summary_i + 1;
+        uint32_t top_i = next / 32;
 
-    // kernel check
-    uint32_t kernel_start_addr = (uint32_t) VIRT_TO_PHYS(&kernel_start);
-    uint32_t kernel_end_addr = (uint32_t) VIRT_TO_PHYS(&kernel_end);
+        if (top_i >= area->top_size)
+            return _KMM_INVALID_FRAME;
 
-    uint32_t kernel_start_frame = (uint32_t)ALIGN(kernel_start_addr, _KMM_BLOCK_ALIGNMENT);
-    kernel_start_frame /= _KMM_BLOCK_SIZE;
+        bits = area->top[top_i] & ((uint32_t)0xFFFFFFFF << (next % 32));
 
-    uint32_t kernel_end_frame = (uint32_t)ALIGN(kernel_end_addr, _KMM_BLOCK_ALIGNMENT);
-    kernel_end_frame /= _KMM_BLOCK_SIZE;
+        while (!bits)
+        {
+            if (++top_i >= area->top_size)
+                return _KMM_INVALID_FRAME;
 
-    if (frame_number >= kernel_start_frame && frame_number < kernel_end_frame)
-        return;
+            bits = area->top[top_i];
+        }
 
-    // bitmap check (had to recompute start addr)
-    uint32_t bitmap_start_addr = (uint32_t)ALIGN(kernel_end_addr, _KMM_BLOCK_ALIGNMENT);
+        summary_i = (top_i * 32) + (uint32_t)__builtin_ctz(bits);
+        bits = area->summary[summary_i];
+    }
 
-    uint32_t bitmap_end_addr = bitmap_start_addr + (bitmap_size * sizeof(uint32_t));
-    bitmap_end_addr = (uint32_t)ALIGN(bitmap_end_addr, _KMM_BLOCK_ALIGNMENT);
+    index = (summary_i * 32) + (uint32_t)__builtin_ctz(bits);
 
-    uint32_t bitmap_start_frame = bitmap_start_addr / _KMM_BLOCK_SIZE;
-    uint32_t bitmap_end_frame = bitmap_end_addr / _KMM_BLOCK_SIZE;
+    return (index * 32) + (uint32_t)__builtin_ctz(area->bits[index]);
+}
 
-    if (frame_number >= bitmap_start_frame && frame_number < bitmap_end_frame)
-        return;
+// hands the block of 2^order frames at 'frame' to the free areas, merging it
+// with its buddy for as long as the buddy is free as well
+static void _kmm_buddy_free_block(uint32_t frame, uint32_t order)
+{
+    uint32_t block = frame >> order;
 
-    // clear corresponding bit
-    uint32_t index = frame_number / 32;
-    uint32_t offset = frame_number % 32;
+    while (order < KMM_BUDDY_MAX_ORDER)
+    {
+        uint32_t buddy = block ^ 1;
+        kmm_free_area_t* area = &free_area[order];
 
-    // check if already free
-    if ((bitmap[index] & (1u << offset)) == 0)
-        return;
+        if (buddy >= area->blocks || !_kmm_area_test(area, buddy))
+            break;
 
-    // free the frame
-    bitmap[index] &= ~(1u << offset);
+        _kmm_area_clear(area, buddy);
 
-    // update counters
-    free_frames += 1;
-    used_frames -= 1;
+        block >>= 1;
+        order += 1;
+    }
+
+    _kmm_area_set(&free_area[order], block);
+}
+
+// hands [start, end) to the free areas as the largest aligned blocks that fit
+static void _kmm_buddy_free_run(uint32_t start, uint32_t end)
+{
+    while (start < end)
+    {
+        uint32_t order = KMM_BUDDY_MAX_ORDER;
+
+        while (order > 0 && ((start & ((1u << order) - 1)) != 0 || end - start < (1u << order)))
+            order--;
+
+        _kmm_buddy_free_block(start, order);
+
+        start += (1u << order);
+    }
+}
+
+// takes the lowest block of 2^order frames inside [start, end) out of the
+// free areas, splitting a larger block if needed. returns its first frame (or
+// _KMM_INVALID_FRAME)
+static uint32_t _kmm_buddy_alloc_block(uint32_t order, uint32_t start, uint32_t end)
+{
+    uint32_t current = order;
+    uint32_t block = _KMM_INVALID_FRAME;
+
+    // smallest order with a free block in the range, the range is aligned to
+    // the largest block (zone boundaries) so blocks are either inside or outside
+    for (; current <= KMM_BUDDY_MAX_ORDER; current++)
+    {
+        block = _kmm_area_find_from(&free_area[current], start >> current);
+
+        if (block != _KMM_INVALID_FRAME && (block << current) < end)
+            break;
+    }
+
+    if (current > KMM_BUDDY_MAX_ORDER)
+        return _KMM_INVALID_FRAME;
+
+    _kmm_area_clear(&free_area[current], block);
+
+    // split down, the upper halves go back to the free areas
+    while (current > order)
+    {
+        current--;
+        block <<= 1;
+
+        _kmm_area_set(&free_area[current], block + 1);
+    }
+
+    return block << order;
+}
+
+// removes every free frame in [start, end) from the free areas, the parts of
+// the containing blocks outside the range stay free
+static void _kmm_buddy_remove_range(uint32_t start, uint32_t end)
+{
+    uint32_t frame = start;
+
+    while (frame < end)
+    {
+        // find the free block holding this frame
+        uint32_t order = 0;
+
+        while (order <= KMM_BUDDY_MAX_ORDER)
+        {
+            uint32_t block = frame >> order;
+
+            if (block < free_area[order].blocks && _kmm_area_test(&free_area[order], block))
+                break;
+
+            order++;
+        }
+
+        // frame is used, skip ahead to the next free one
+        if (order > KMM_BUDDY_MAX_ORDER)
+        {
+            frame = _kmm_find_free_from(frame + 1);
+            continue;
+        }
+
+        uint32_t block_start = (frame >> order) << order;
+        uint32_t block_end = block_start + (1u << order);
+
+        _kmm_area_clear(&free_area[order], frame >> order);
+
+        // give back the parts before and after the range
+        _kmm_buddy_free_run(block_start, frame);
+
+        if (block_end > end)
+        {
+            _kmm_buddy_free_run(end, block_end);
+            block_end = end;
+        }
+
+        frame = block_end;
+    }
+}
+
+// rebuilds the free areas from the bitmap
+static void _kmm_buddy_seed(void)
+{
+    uint32_t total_frames = kmm_get_total_frames();
+
+    memset(free_area[0].bits, 0, free_area_bytes);
+
+    for (uint32_t order = 0; order <= KMM_BUDDY_MAX_ORDER; order++)
+        free_area[order].free_blocks = 0;
+
+    // walk the free runs of the bitmap
+    uint32_t frame = _kmm_find_free_from(0);
+
+    while (frame != _KMM_INVALID_FRAME && frame < total_frames)
+    {
+        uint32_t used = _kmm_find_used_in_range(frame, total_frames - frame);
+        uint32_t end = (used == _KMM_INVALID_FRAME) ? total_frames : used;
+
+        _kmm_buddy_free_run(frame, end);
+
+        if (end >= total_frames)
+            break;
+
+        frame = _kmm_find_free_from(end);
+    }
+}
+
+uint32_t kmm_get_free_blocks(uint32_t order)
+{
+    if (order > KMM_BUDDY_MAX_ORDER)
+        return 0;
+
+    return free_area[order].free_blocks;
+}
+#endif
+
+// frame descriptor helpers
+static inline void _kmm_desc_init(uint32_t frame, uint8_t order)
+{
+    // frames above 4GB have no descriptor
+    if (frame >= frame_desc_count)
+        return;
+
+    frame_desc_t* desc = &frame_descs[frame];
+
+    desc->refcount = 1;
+    desc->mapcount = 0;
+    desc->flags = 0;
+    desc->order = order;
+    desc->pte_count = 0;
+}
+
+// every frame of a run is referenced once, the first one records the run's
+// order (smallest power of two covering it)
+static void _kmm_desc_init_run(uint32_t start, uint32_t count)
+{
+    uint8_t order = 0;
+
+    while ((1u << order) < count)
+        order++;
+
+    for (uint32_t frame = start; frame < start + count; frame++)
+        _kmm_desc_init(frame, 0);
+
+    frame_descs[start].order = order;
+}
+
+// tags the used frames in [start, start + count) that nobody references yet
+// as kernel owned
+static void _kmm_desc_reserve(uint32_t start, uint32_t count)
+{
+    uint32_t end = start + count;
+
+    if (end > frame_desc_count)
+        end = frame_desc_count;
+
+    for (uint32_t frame = start; frame < end; frame++)
+    {
+        // skip whole free words
+        if ((frame % 32) == 0 && bitmap[frame / 32] == 0)
+        {
+            frame += 31;
+            continue;
+        }
+
+        if (!_kmm_bitmap_test(frame) || frame_descs[frame].refcount != 0)
+            continue;
+
+        frame_descs[frame].refcount = 1;
+        frame_descs[frame].flags = KMM_FRAME_KERNEL;
+    }
+}
+
+// marks the used frames in [start, start + count) free, returns how many
+// frames changed state
+static uint32_t _kmm_release_range(uint32_t start, uint32_t count)
+{
+    // freed frames lose their descriptor state
+    if (start < frame_desc_count)
+    {
+        uint32_t descs = (count < frame_desc_count - start) ? count : (frame_desc_count - start);
+
+        memset(&frame_descs[start], 0, descs * sizeof(frame_desc_t));
+    }
+
+#ifdef KMM_BUDDY
+    uint32_t end = start + count;
+    uint32_t released = 0;
+
+    // every used run inside the range goes back to the free areas
+    while (start < end)
+    {
+        uint32_t used = _kmm_find_used_in_range(start, end - start);
+
+        if (used == _KMM_INVALID_FRAME)
+            break;
+
+        uint32_t run_end = _kmm_find_free_from(used);
+
+        if (run_end > end)
+            run_end = end;
+
+        released += _kmm_bitmap_clear_range(used, run_end - used);
+        _kmm_buddy_free_run(used, run_end);
+
+        start = run_end;
+    }
+
+    return released;
+#else
+    return _kmm_bitmap_clear_range(start, count);
+#endif
+}
+
+// marks the free frames in [start, start + count) used, returns how many
+// frames changed state
+static uint32_t _kmm_reserve_range(uint32_t start, uint32_t count)
+{
+#ifdef KMM_BUDDY
+    _kmm_buddy_remove_range(start, start + count);
+#endif
+
+    return _kmm_bitmap_set_range(start, count);
+}
+
+
+// helpers
+void kmm_get_available_mem()
+{
+    // BIOS dumps memory size onto MEM_SIZE_LOC -> read this in
+    e801_memsize_t* mem_size = (e801_memsize_t*) MEM_SIZE_LOC;
+
+    // calculate and return available memory (in KB)
+    available_size = AVLBL_MEM(mem_size->memLow, mem_size->memHigh);
+}
+
+void kmm_get_physical_mem_map()
+{
+    // BIOS dumps the array onto MEM_MAP_LOC -> read it in
+    mem_map_entries_count = *(uint32_t*) MEM_MAP_ENTRY_COUNT_LOC;
+    mem_map = (e820_entry_t*) MEM_MAP_LOC;
+}
+
+void kmm_print_status(void)
+{
+    LOG_DEBUG("Total memory: %u KB\n", available_size);
+    LOG_DEBUG("Used frames: %u\n", used_frames);
+    LOG_DEBUG("Free frames: %u\n", free_frames);
+
+    LOG_DEBUG("Init cycles: %llu\n", init_cycles);
+    LOG_DEBUG("Zero pool: %u frames, %u hits, %u misses\n", zero_pool_count, zero_pool_hits, zero_pool_misses);
+    LOG_DEBUG("Zone free frames: DMA %u, NORMAL %u, HIGH %u\n", zone_free[KMM_ZONE_DMA], zone_free[KMM_ZONE_NORMAL], zone_free[KMM_ZONE_HIGH]);
+
+#ifdef KMM_BUDDY
+    for (uint32_t order = 0; order <= KMM_BUDDY_MAX_ORDER; order++)
+        LOG_DEBUG("Order %u free blocks: %u\n", order, free_area[order].free_blocks);
+#endif
+    
+}
+
+bitmap_frame_info_t kmm_get_first_free_bit(void)
+{
+    bitmap_frame_info_t free_frame_info;
+
+    // set with sentinel values
+    free_frame_info.index = (uint32_t) 0xFFFFFFFF;
+    free_frame_info.offset = (uint32_t) 0xFFFFFFFF;
+
+    // walk the summary levels instead of scanning the bitmap
+    uint32_t frame = _kmm_find_free_from(0);
+
+    // no free frames
+    if (frame == _KMM_INVALID_FRAME)
+        return free_frame_info;
+
+    free_frame_info.index = frame / 32;
+    free_frame_info.offset = frame % 32;
+
+    return free_frame_info;
+}
+
+
+// API definitions
+uint32_t kmm_get_total_frames(void)
+{
+    return (used_frames + free_frames);
+}
+
+uint32_t kmm_get_used_frames(void)
+{
+    return used_frames;
+}
+
+uint64_t kmm_get_init_cycles(void)
+{
+    return init_cycles;
+}
+
+void kmm_init(void)
+{
+    LOG_DEBUG("------------------------------\n");
+    LOG_DEBUG("KMM INIT\n");
+
+    uint64_t init_start = rdtsc();
+
+    kmm_get_available_mem();
+    kmm_get_physical_mem_map();
+
+    // get physical addressesof kernel start and end
+    uint32_t kstart_addr = (uint32_t) VIRT_TO_PHYS(&kernel_start);
+    uint32_t kend_addr = (uint32_t) VIRT_TO_PHYS(&kernel_end);
+
+    // calculate bitmap_size (with ceil) -> this is the number of 32bit entries required
+    uint32_t pageframe_total = available_size / (_KMM_BLOCK_SIZE / 1024);
+
+#ifdef VMM_PAE
+    // e801 stops at 4GB, the memory map also describes the RAM above it
+    for (uint32_t i = 0; i < mem_map_entries_count; i++)
+    {
+        e820_entry_t* region = &mem_map[i];
+
+        if (region->type != 1)
+            continue;
+
+        uint64_t region_end = (((uint64_t)region->baseHigh << 32) | region->baseLow) +
+                              (((uint64_t)region->lengthHigh << 32) | region->lengthLow);
+        uint64_t end_frame = region_end / _KMM_BLOCK_SIZE;
+
+        if (end_frame > KMM_MAX_FRAMES)
+            end_frame = KMM_MAX_FRAMES;
+
+        if (end_frame > pageframe_total)
+            pageframe_total = (uint32_t)end_frame;
+    }
+#endif
+
+    if (pageframe_total > KMM_MAX_FRAMES)
+        pageframe_total = KMM_MAX_FRAMES;
+
+    // set number of frames (total number of bits)
+    used_frames = pageframe_total;
+    free_frames = 0;
+
+    // zone boundaries, clamped to the memory present. every frame starts out
+    // used so no zone has free frames yet
+    zone_end[KMM_ZONE_DMA] = KMM_ZONE_DMA_END / _KMM_BLOCK_SIZE;
+    zone_end[KMM_ZONE_NORMAL] = KMM_ZONE_NORMAL_END / _KMM_BLOCK_SIZE;
+    zone_end[KMM_ZONE_HIGH] = pageframe_total;
+
+    for (uint32_t zone = 0; zone < KMM_ZONE_COUNT; zone++)
+    {
+        if (zone_end[zone] > pageframe_total)
+            zone_end[zone] = pageframe_total;
+
+        zone_free[zone] = 0;
+    }
+
+    // the zero pool starts empty
+    zero_pool_count = 0;
+    zero_pool_hits = 0;
+    zero_pool_misses = 0;
+    
+    bitmap_size = (pageframe_total + 31) / 32;
+
+    // summary levels: one bit per bitmap word, then one bit per summary word
+    bitmap_summary_size = (bitmap_size + 31) / 32;
+    bitmap_summary_top_size = (bitmap_summary_size + 31) / 32;
+
+    // compute start-of-bitmap address (aligned)
+    uint32_t bitmap_start_addr = (uint32_t) ALIGN(kend_addr, _KMM_BLOCK_ALIGNMENT);
+
+    // place bitmap right after kernel code and data (kernel_end), the summary
+    // levels follow the bitmap directly
+    bitmap = (uint32_t*) PHYS_TO_VIRT(bitmap_start_addr);
+    bitmap_summary = bitmap + bitmap_size;
+    bitmap_summary_top = bitmap_summary + bitmap_summary_size;
+
+#ifdef KMM_BUDDY
+    // buddy free areas follow the summary levels, one per order
+    uint32_t* area_mem = bitmap_summary_top + bitmap_summary_top_size;
+    free_area_bytes = 0;
+
+    for (uint32_t order = 0; order <= KMM_BUDDY_MAX_ORDER; order++)
+    {
+        kmm_free_area_t* area = &free_area[order];
+
+        area->blocks = pageframe_total >> order;
+        area->size = (area->blocks + 31) / 32;
+        area->summary_size = (area->size + 31) / 32;
+        area->top_size = (area->summary_size + 31) / 32;
+        area->free_blocks = 0;
+
+        area->bits = area_mem;
+        area->summary = area->bits + area->size;
+        area->top = area->summary + area->summary_size;
+
+        area_mem = area->top + area->top_size;
+        free_area_bytes += (area->size + area->summary_size + area->top_size) * sizeof(uint32_t);
+    }
+#endif
+
+    // frame descriptors come last, one per frame below 4GB
+    frame_desc_count = 0;
+    frame_descs = (frame_desc_t*) ((uint8_t*)bitmap + _kmm_metadata_bytes());
+    frame_desc_count = (pageframe_total < _KMM_PTR_FRAMES) ? pageframe_total : _KMM_PTR_FRAMES;
+    
+    // compute end-of-bitmap address (unaligned)
+    uint32_t bitmap_end_addr = bitmap_start_addr + _kmm_metadata_bytes();
+
+    // ensure the bitmap end is block-aligned so reservation covers full frames
+    bitmap_end_addr = (uint32_t) ALIGN(bitmap_end_addr, _KMM_BLOCK_ALIGNMENT);
+
+    // initialise bitmap (and summaries) as fully used, frames are released
+    // from the memory map below. this also keeps the padding bits past the
+    // last frame set, so the search never returns them
+    memset(bitmap, (uint8_t)0xFF, (bitmap_size + bitmap_summary_size + bitmap_summary_top_size) * sizeof(uint32_t));
+
+#ifdef KMM_BUDDY
+    // free areas start out empty, they are seeded once the bitmap is final
+    memset(free_area[0].bits, 0, free_area_bytes);
+#endif
+
+    // no frame is referenced yet, reserved frames are tagged once known
+    memset(frame_descs, 0, frame_desc_count * sizeof(frame_desc_t));
+
+
+    // iterate through the mem_map
+    for (uint32_t i = 0; i < mem_map_entries_count; i++)
+    {
+        // get current region
+        e820_entry_t* region = &mem_map[i];
+
+        // skip if unusable
+        if (region->type != 1)
+            continue;
+
+        // get base and lengths
+        uint32_t base_low = region->baseLow;
+        uint32_t base_high = region->baseHigh;
+        uint32_t length_low = region->lengthLow;
+        uint32_t length_high = region->lengthHigh;
+
+        // get region type
+        uint32_t type = region->type;
+
+        // merge base and lengths into a 64-bit field
+        uint64_t base_addr = ((uint64_t)base_high << 32) | ((uint64_t)base_low);
+        uint64_t length = ((uint64_t)length_high << 32) | ((uint64_t)length_low);
+
+        // compute start and end points of the region, rounding up and down for alighment
+        uint64_t region_start = (uint64_t)ALIGN(base_addr, _KMM_BLOCK_ALIGNMENT);
+        uint64_t region_end = (uint64_t)ALIGN(base_addr + length, _KMM_BLOCK_ALIGNMENT);
+
+        // from the endpoints, get the starting and ending frame number
+        uint64_t starting_frame = (region_start) / (_KMM_BLOCK_SIZE);
+        uint64_t ending_frame = (region_end) / (_KMM_BLOCK_SIZE);
+
+        // the bitmap only covers pageframe_total frames
+        if (ending_frame > pageframe_total)
+            ending_frame = pageframe_total;
+
+        if (starting_frame >= ending_frame)
+            continue;
+
+        // release the region a word at a time, frames already released by
+        // an overlapping entry don't count twice
+        uint32_t released = _kmm_bitmap_clear_range((uint32_t)starting_frame, (uint32_t)(ending_frame - starting_frame));
+
+        free_frames += released;
+        used_frames -= released;
+
+    }
+
+
+    // every frame still used here is a hole in the memory map, those go into
+    // the reserved-range table (walked a run at a time)
+    reserved_range_count = 0;
+
+    uint32_t hole = _kmm_find_used_in_range(0, pageframe_total);
+
+    while (hole != _KMM_INVALID_FRAME)
+    {
+        uint32_t hole_end = _kmm_find_free_from(hole);
+
+        if (hole_end > pageframe_total)
+            hole_end = pageframe_total;
+
+        _kmm_reserved_add(hole, hole_end);
+
+        if (hole_end >= pageframe_total)
+            break;
+
+        hole = _kmm_find_used_in_range(hole_end, pageframe_total - hole_end);
+    }
+
+
+    // reserve low memory regions (640KiB instead of till 1MB for ... reasons ...)
+    kmm_setup_memory_region(0x00000000, 0x000A0000, true);
+
+
+    // reserve kernel frames
+    uint32_t kernel_start_frame = (uint32_t)ALIGN(kstart_addr, _KMM_BLOCK_ALIGNMENT);
+    kernel_start_frame /= _KMM_BLOCK_SIZE;
+
+    uint32_t kernel_end_frame = (uint32_t)ALIGN(kend_addr, _KMM_BLOCK_ALIGNMENT);
+    kernel_end_frame /= _KMM_BLOCK_SIZE;
+    
+    // only frames that were free count (avoid double-counting)
+    uint32_t reserved = _kmm_bitmap_set_range(kernel_start_frame, kernel_end_frame - kernel_start_frame);
+
+    free_frames -= reserved;
+    used_frames += reserved;
+    
+    // reserve bitmap frames
+    uint32_t bitmap_start_frame = bitmap_start_addr / _KMM_BLOCK_SIZE;
+    uint32_t bitmap_end_frame = bitmap_end_addr / _KMM_BLOCK_SIZE;
+    
+    reserved = _kmm_bitmap_set_range(bitmap_start_frame, bitmap_end_frame - bitmap_start_frame);
+
+    free_frames -= reserved;
+    used_frames += reserved;
+
+    // reserve frame 0
+    if (!_kmm_bitmap_test(0)) 
+    {  
+        // mark as used
+        _kmm_bitmap_set(0);
+        
+        free_frames -= 1;
+        used_frames += 1;
+    }
+
+
+#ifdef KMM_BUDDY
+    // index the remaining free frames by block size
+    _kmm_buddy_seed();
+#endif
+
+    // whatever is still used now belongs to the kernel (low memory, kernel
+    // image, kmm metadata and memory map holes)
+    _kmm_desc_reserve(0, pageframe_total);
+
+    // frames below 1MB (including frame 0), the kernel image and the kmm
+    // metadata can never be freed
+    _kmm_reserved_add(0, 0x100000 / _KMM_BLOCK_SIZE);
+    _kmm_reserved_add(kernel_start_frame, kernel_end_frame);
+    _kmm_reserved_add(bitmap_start_frame, bitmap_end_frame);
+
+    // mirror the table in the descriptors so single frees need one lookup
+    for (uint32_t i = 0; i < reserved_range_count; i++)
+    {
+        uint32_t end = reserved_ranges[i].end;
+
+        if (end > frame_desc_count)
+            end = frame_desc_count;
+
+        for (uint32_t frame = reserved_ranges[i].start; frame < end; frame++)
+            frame_descs[frame].flags |= KMM_FRAME_RESERVED;
+    }
+
+    init_cycles = rdtsc() - init_start;
+
+    // TODO: print debug info
+    kmm_print_status();
+}
+
+void kmm_setup_memory_region(uint32_t base, uint32_t size, bool is_reserved)
+{
+    // don't modify the boot/reserved low-memory area when clearing regions
+    // const uint32_t reserved_end = 0x100000;
+
+    // if (!is_reserved)
+    // {
+    //     // If the entire region lies below reserved_end, nothing to do
+    //     if ((uint64_t)base + (uint64_t)size <= (uint64_t)reserved_end)
+    //         return;
+
+    //     // If region partially overlaps reserved area, adjust to skip the reserved portion
+    //     if (base < reserved_end)
+    //     {
+    //         uint32_t overlap = reserved_end - base;
+    //         base += overlap;
+    //         size -= overlap;
+    //     }
+    // }
+
+    // convert offsets into a physical region
+    uint64_t region_start = (uint64_t)ALIGN(base, _KMM_BLOCK_ALIGNMENT);
+    uint64_t region_end = (uint64_t)ALIGN(base + size, _KMM_BLOCK_ALIGNMENT);
+
+    uint32_t starting_frame = (region_start) / (_KMM_BLOCK_SIZE);
+    uint32_t ending_frame = (region_end) / (_KMM_BLOCK_SIZE);
+
+    // clamp to the frames covered by the bitmap
+    uint32_t total_frames = kmm_get_total_frames();
+
+    if (ending_frame > total_frames)
+        ending_frame = total_frames;
+
+    if (starting_frame >= ending_frame)
+        return;
+
+    // conditionally set frames a word at a time, only frames that actually
+    // change state count towards the counters
+    if (is_reserved)
+    {
+        uint32_t changed = _kmm_reserve_range(starting_frame, ending_frame - starting_frame);
+        _kmm_desc_reserve(starting_frame, ending_frame - starting_frame);
+
+        free_frames -= changed;
+        used_frames += changed;
+    }
+
+    else
+    {
+        uint32_t changed = _kmm_release_range(starting_frame, ending_frame - starting_frame);
+
+        free_frames += changed;
+        used_frames -= changed;
+    }
+
+}
+
+// takes a frame from the zero pool (or NULL when empty)
+static void* _kmm_zero_pool_pop(void)
+{
+    if (zero_pool_count == 0)
+        return NULL;
+
+    void* frame = zero_pool[--zero_pool_count];
+
+    // caller owns the contents from now on
+    frame_descs[(uint32_t)frame / _KMM_BLOCK_SIZE].flags &= ~KMM_FRAME_ZEROED;
+
+    return frame;
+}
+
+// lets the reclaim handler free frames when taking 'count' more would leave
+// fewer than the watermark
+static void _kmm_reclaim(uint32_t count)
+{
+    if (!reclaim_handler || reclaim_running || free_frames >= reclaim_watermark + count)
+        return;
+
+    reclaim_running = true;
+    reclaim_handler(reclaim_watermark + count - free_frames);
+    reclaim_running = false;
+}
+
+// single frame from 'zone' only (no fallback to other zones), below frame
+// 'limit'. returns the frame number (or _KMM_INVALID_FRAME)
+static uint32_t _kmm_frame_alloc(uint32_t zone, uint32_t limit)
+{
+    uint32_t end = (zone_end[zone] < limit) ? zone_end[zone] : limit;
+
+    if (zone_free[zone] == 0 || _kmm_zone_start(zone) >= end)
+        return _KMM_INVALID_FRAME;
+
+#ifdef KMM_BUDDY
+    // smallest free block, split down to a single frame
+    uint32_t frame = _kmm_buddy_alloc_block(0, _kmm_zone_start(zone), end);
+
+    if (frame == _KMM_INVALID_FRAME)
+        return _KMM_INVALID_FRAME;
+
+    _kmm_bitmap_set(frame);
+    _kmm_desc_init(frame, 0);
+
+    used_frames += 1;
+    free_frames -= 1;
+
+    return frame;
+#else
+    // find first free frame of the zone
+    uint32_t frame_number = _kmm_find_free_from(_kmm_zone_start(zone));
+
+    // no free frames (the search ran into the next zone)
+    if (frame_number == _KMM_INVALID_FRAME || frame_number >= end)
+        return _KMM_INVALID_FRAME;
+
+    // // never return frame 0; if encountered, reserve it and continue searching
+    // if (frame_number == 0)
+    // {
+    //     // mark as used if not already
+    //     if ((bitmap[free_frame_info.index] & (1u << free_frame_info.offset)) == 0) 
+    //     {
+    //         bitmap[free_frame_info.index] |= (1u << free_frame_info.offset);
+    //         used_frames += 1;
+    //         free_frames -= 1;
+    //     }
+    // }
+
+    // mark that frame as used
+    _kmm_bitmap_set(frame_number);
+    _kmm_desc_init(frame_number, 0);
+
+    // update the usage counter
+    used_frames += 1;
+
+    // update the free counter
+    free_frames -= 1;
+
+    return frame_number;
+#endif
+
+}
+
+// fallback towards the lower zones: HIGH -> NORMAL -> DMA
+static uint32_t _kmm_frame_alloc_fallback(uint32_t zone, uint32_t limit)
+{
+    for (uint32_t i = zone + 1; i > 0; i--)
+    {
+        uint32_t frame = _kmm_frame_alloc(i - 1, limit);
+
+        if (frame != _KMM_INVALID_FRAME)
+            return frame;
+    }
+
+    return _KMM_INVALID_FRAME;
+}
+
+void* kmm_frame_alloc_zone(uint32_t zone)
+{
+    if (zone >= KMM_ZONE_COUNT)
+        return NULL;
+
+    _kmm_reclaim(1);
+
+    // only frames a pointer can name
+    uint32_t frame = _kmm_frame_alloc_fallback(zone, _KMM_PTR_FRAMES);
+
+    if (frame == _KMM_INVALID_FRAME)
+        return NULL;
+
+    return (void*) (frame * _KMM_BLOCK_SIZE);
+}
+
+phys_addr_t kmm_frame_alloc_phys(uint32_t zone)
+{
+    // frame 0 is never handed out, so 0 doubles as the failure value
+    if (zone >= KMM_ZONE_COUNT)
+        return 0;
+
+    _kmm_reclaim(1);
+
+    uint32_t frame = _kmm_frame_alloc_fallback(zone, KMM_MAX_FRAMES);
+
+    if (frame == _KMM_INVALID_FRAME)
+        return 0;
+
+    return (phys_addr_t)frame * _KMM_BLOCK_SIZE;
+}
+
+void* kmm_frame_alloc(void)
+{
+    // ordinary allocations must stay reachable through the physmap and only
+    // dip into the DMA zone once NORMAL is exhausted
+    void* frame = kmm_frame_alloc_zone(KMM_ZONE_NORMAL);
+
+    // out of free frames, fall back to the zero pool
+    if (!frame)
+        frame = _kmm_zero_pool_pop();
+
+    return frame;
+}   
+
+void kmm_frame_free(void* phys_addr)
+{
+    kmm_frame_free_phys((phys_addr_t)(uintptr_t)phys_addr);
+}
+
+void kmm_frame_free_phys(phys_addr_t phys_addr)
+{
+    // validate physical address
+    if (phys_addr == 0)
+        return;
+
+    uint32_t total_frames = kmm_get_total_frames();
+
+    // check if physical address is page aligned
+    if ((phys_addr % _KMM_BLOCK_ALIGNMENT) != 0)
+        return;
+
+    // convert to frame index
+    phys_addr_t frame = phys_addr / (_KMM_BLOCK_SIZE);
+
+    // validate frame index
+    if (frame >= total_frames)
+        return;
+
+    uint32_t frame_number = (uint32_t) frame;
+
+    // check (not frame 0, reserved, bitmap, kernel region). frames without
+    // a descriptor are looked up in the reserved-range table
+    if (frame_number < frame_desc_count)
+    {
+        if (frame_descs[frame_number].flags & KMM_FRAME_RESERVED)
+            return;
+    }
+
+    else if (_kmm_range_is_protected(frame_number, frame_number + 1))
+        return;
+
+    // check if already free
+    if (!_kmm_bitmap_test(frame_number))
+        return;
+
+    // free the frame
+    _kmm_bitmap_clear(frame_number);
+
+    if (frame_number < frame_desc_count)
+        memset(&frame_descs[frame_number], 0, sizeof(frame_desc_t));
+
+#ifdef KMM_BUDDY
+    // merge back into the free areas
+    _kmm_buddy_free_block(frame_number, 0);
+#endif
+
+    // update counters
+    free_frames += 1;
+    used_frames -= 1;
+
+}
+
+// run of 'count' frames aligned to 'align' frames from 'zone' only
+static void* _kmm_frames_alloc(uint32_t count, uint32_t align, uint32_t zone)
+{
+    // not enough free frames in the zone, no need to search
+    if (count > zone_free[zone])
+        return NULL;
+
+    uint32_t zone_start = _kmm_zone_start(zone);
+    uint32_t end = zone_end[zone];
+
+#ifdef KMM_BUDDY
+    // runs up to the largest order come straight from the free areas, a block
+    // of order k is always aligned to 2^k frames
+    if (count <= (1u << KMM_BUDDY_MAX_ORDER) && align <= (1u << KMM_BUDDY_MAX_ORDER))
+    {
+        uint32_t order = 0;
+
+        while ((1u << order) < count || (1u << order) < align)
+            order++;
+
+        uint32_t frame = _kmm_buddy_alloc_block(order, zone_start, end);
+
+        if (frame == _KMM_INVALID_FRAME)
+            return NULL;
+
+        // frames past the run go back to the free areas
+        _kmm_buddy_free_run(frame + count, frame + (1u << order));
+        _kmm_bitmap_set_range(frame, count);
+        _kmm_desc_init_run(frame, count);
+
+        used_frames += count;
+        free_frames -= count;
+
+        return (void*) (frame * _KMM_BLOCK_SIZE);
+    }
+#endif
+
+    // candidate runs start at a free frame, rounded up to the alignment
+    uint32_t start = _kmm_find_free_from(zone_start);
+
+    while (start != _KMM_INVALID_FRAME)
+    {
+        start = ALIGN_SIZE(start, align);
+
+        // ran off the end of the zone (or wrapped around)
+        if (start >= end || count > end - start)
+            return NULL;
+
+        // check the whole run a word at a time
+        uint32_t used = _kmm_find_used_in_range(start, count);
+
+        if (used == _KMM_INVALID_FRAME)
+        {
+            // mark the run as used
+            _kmm_reserve_range(start, count);
+            _kmm_desc_init_run(start, count);
+
+            used_frames += count;
+            free_frames -= count;
+
+            return (void*) (start * _KMM_BLOCK_SIZE);
+        }
+
+        // restart the search after the used frame
+        start = _kmm_find_free_from(used + 1);
+    }
+
+    // no run large enough
+    return NULL;
+}
+
+void* kmm_frames_alloc(uint32_t count, uint32_t align)
+{
+    // align is in frames and must be a power of two (0 or 1 -> no alignment)
+    if (count == 0)
+        return NULL;
+
+    if (align == 0)
+        align = 1;
+
+    if ((align & (align - 1)) != 0)
+        return NULL;
+
+    _kmm_reclaim(count);
+
+    // runs never span two zones, NORMAL first to spare the DMA zone
+    void* run = _kmm_frames_alloc(count, align, KMM_ZONE_NORMAL);
+
+    if (!run)
+        run = _kmm_frames_alloc(count, align, KMM_ZONE_DMA);
+
+    return run;
+}
+
+void kmm_frames_free(void* phys_addr, uint32_t count)
+{
+    // validate physical address
+    if (phys_addr == NULL || count == 0)
+        return;
+
+    uint32_t addr = (uint32_t) phys_addr;
+    uint32_t total_frames = kmm_get_total_frames();
+
+    // check if physical address is page aligned
+    if ((addr % _KMM_BLOCK_ALIGNMENT) != 0)
+        return;
+
+    uint32_t frame_number = addr / (_KMM_BLOCK_SIZE);
+
+    // validate the whole run
+    if (frame_number >= total_frames || count > total_frames - frame_number)
+        return;
+
+    if (_kmm_range_is_protected(frame_number, frame_number + count))
+        return;
+
+    // clear the run, only frames that were used count towards the counters
+    uint32_t freed = _kmm_release_range(frame_number, count);
+
+    free_frames += freed;
+    used_frames -= freed;
+}
+
+// harvests up to 'count' free frames of 'zone' (below 4GB) into 'frames',
+// taking every wanted free bit of a bitmap word at once. returns how many
+// frames were taken
+static uint32_t _kmm_frame_alloc_batch(void** frames, uint32_t count, uint32_t zone)
+{
+    uint32_t start = _kmm_zone_start(zone);
+    uint32_t end = (zone_end[zone] < _KMM_PTR_FRAMES) ? zone_end[zone] : _KMM_PTR_FRAMES;
+    uint32_t taken = 0;
+
+    if (zone_free[zone] == 0 || start >= end)
+        return 0;
+
+#ifdef KMM_BUDDY
+    // largest blocks that still fit the request, handed out frame by frame
+    uint32_t order = KMM_BUDDY_MAX_ORDER;
+
+    while (taken < count)
+    {
+        while (order > 0 && (1u << order) > count - taken)
+            order--;
+
+        uint32_t frame = _kmm_buddy_alloc_block(order, start, end);
+
+        if (frame == _KMM_INVALID_FRAME)
+        {
+            if (order == 0)
+                break;
+
+            order--;
+            continue;
+        }
+
+        _kmm_bitmap_set_range(frame, 1u << order);
+
+        for (uint32_t i = 0; i < (1u << order); i++)
+        {
+            _kmm_desc_init(frame + i, 0);
+            frames[taken++] = (void*) ((frame + i) * _KMM_BLOCK_SIZE);
+        }
+    }
+#else
+    uint32_t frame = _kmm_find_free_from(start);
+
+    // zone boundaries are word aligned, a word never spans two zones
+    while (taken < count && frame != _KMM_INVALID_FRAME && frame < end)
+    {
+        uint32_t index = frame / 32;
+        uint32_t bits = ~bitmap[index] & ((uint32_t)0xFFFFFFFF << (frame % 32));
+        uint32_t mask = 0;
+
+        while (bits && taken < count)
+        {
+            uint32_t bit = (uint32_t)__builtin_ctz(bits);
+
+            bits &= bits - 1;
+            mask |= (1u << bit);
+
+            _kmm_desc_init((index * 32) + bit, 0);
+            frames[taken++] = (void*) (((index * 32) + bit) * _KMM_BLOCK_SIZE);
+        }
+
+        // one bitmap (and summary) update per word
+        _kmm_bitmap_word_set(index, mask);
+
+        frame = _kmm_find_free_from((index + 1) * 32);
+    }
+#endif
+
+    used_frames += taken;
+    free_frames -= taken;
+
+    return taken;
+}
+
+uint32_t kmm_frame_alloc_batch(void** frames, uint32_t count)
+{
+    if (!frames || count == 0)
+        return 0;
+
+    _kmm_reclaim(count);
+
+    // same policy as kmm_frame_alloc: NORMAL, then DMA, then the zero pool
+    uint32_t taken = _kmm_frame_alloc_batch(frames, count, KMM_ZONE_NORMAL);
+
+    if (taken < count)
+        taken += _kmm_frame_alloc_batch(frames + taken, count - taken, KMM_ZONE_DMA);
+
+    while (taken < count)
+    {
+        void* frame = _kmm_zero_pool_pop();
+
+        if (!frame)
+            break;
+
+        frames[taken++] = frame;
+    }
+
+    return taken;
+}
+
+uint32_t kmm_frame_alloc_batch_zeroed(void** frames, uint32_t count)
+{
+    if (!frames || count == 0)
+        return 0;
+
+    // pooled frames first, only the rest are zeroed here
+    uint32_t taken = 0;
+
+    while (taken < count)
+    {
+        void* frame = _kmm_zero_pool_pop();
+
+        if (!frame)
+            break;
+
+        frames[taken++] = frame;
+    }
+
+    zero_pool_hits += taken;
+
+    uint32_t pooled = taken;
+
+    taken += kmm_frame_alloc_batch(frames + taken, count - taken);
+
+    for (uint32_t i = pooled; i < taken; i++)
+        kmm_frame_zero(frames[i]);
+
+    zero_pool_misses += taken - pooled;
+
+    return taken;
+}
+
+void kmm_frame_free_batch(void** frames, uint32_t count)
+{
+    if (!frames)
+        return;
+
+    uint32_t total_frames = kmm_get_total_frames();
+    uint32_t i = 0;
+
+    while (i < count)
+    {
+        uint32_t addr = (uint32_t) frames[i];
+
+        // NULL, unaligned and out of range entries are skipped
+        if (addr == 0 || (addr % _KMM_BLOCK_ALIGNMENT) != 0 || addr / _KMM_BLOCK_SIZE >= total_frames)
+        {
+            i++;
+            continue;
+        }
+
+        // extend over the entries that continue the run
+        uint32_t frame_number = addr / _KMM_BLOCK_SIZE;
+        uint32_t run = 1;
+
+        while (i + run < count && frame_number + run < total_frames &&
+               (uint32_t) frames[i + run] == addr + (run * _KMM_BLOCK_SIZE))
+            run++;
+
+        // one reserved-range lookup per run, a run touching a protected
+        // range falls back to the per-frame checks
+        if (_kmm_range_is_protected(frame_number, frame_number + run))
+        {
+            for (uint32_t j = 0; j < run; j++)
+                kmm_frame_free(frames[i + j]);
+        }
+
+        else
+        {
+            uint32_t freed = _kmm_release_range(frame_number, run);
+
+            free_frames += freed;
+            used_frames -= freed;
+        }
+
+        i += run;
+    }
+}
+
+frame_desc_t* kmm_frame_desc(void* phys_addr)
+{
+    uint32_t frame_number = (uint32_t) phys_addr / (_KMM_BLOCK_SIZE);
+
+    // validate frame index
+    if (frame_number >= frame_desc_count)
+        return NULL;
+
+    return &frame_descs[frame_number];
+}
+
+uint32_t kmm_frame_get(void* phys_addr)
+{
+    frame_desc_t* desc = kmm_frame_desc(phys_addr);
+
+    // only used frames can gain references
+    if (!desc || desc->refcount == 0)
+        return 0;
+
+    // saturate instead of wrapping back to zero
+    if (desc->refcount != (uint16_t)0xFFFF)
+        desc->refcount += 1;
+
+    return desc->refcount;
+}
+
+uint32_t kmm_frame_put(void* phys_addr)
+{
+    frame_desc_t* desc = kmm_frame_desc(phys_addr);
+
+    // free or untracked frame, nothing to drop
+    if (!desc || desc->refcount == 0)
+        return 0;
+
+    desc->refcount -= 1;
+
+    // last reference gone
+    if (desc->refcount == 0)
+        kmm_frame_free(phys_addr);
+
+    return desc->refcount;
+}
+
+void kmm_frame_set_flags(void* phys_addr, uint8_t flags)
+{
+    frame_desc_t* desc = kmm_frame_desc(phys_addr);
+
+    // only tag frames that are in use
+    if (!desc || desc->refcount == 0)
+        return;
+
+    desc->flags |= flags;
+}
+
+void kmm_frame_zero(void* phys_addr)
+{
+    // a word at a time through the physmap, libc memset goes byte by byte
+    uint32_t* dest = (uint32_t*) PHYS_TO_VIRT(phys_addr);
+    uint32_t words = _KMM_BLOCK_SIZE / sizeof(uint32_t);
+
+    asm volatile ("rep stosl" : "+D"(dest), "+c"(words) : "a"(0) : "memory");
+}
+
+void kmm_frame_copy(void* dst_phys, void* src_phys)
+{
+    // same as kmm_frame_zero, a word at a time through the physmap
+    uint32_t* dest = (uint32_t*) PHYS_TO_VIRT(dst_phys);
+    uint32_t* src = (uint32_t*) PHYS_TO_VIRT(src_phys);
+    uint32_t words = _KMM_BLOCK_SIZE / sizeof(uint32_t);
+
+    asm volatile ("rep movsl" : "+D"(dest), "+S"(src), "+c"(words) :: "memory");
+}
+
+void* kmm_frame_alloc_zeroed(void)
+{
+    // pooled frames skip the memset
+    void* frame = _kmm_zero_pool_pop();
+
+    if (frame)
+    {
+        zero_pool_hits += 1;
+        return frame;
+    }
+
+    zero_pool_misses += 1;
+
+    frame = kmm_frame_alloc_zone(KMM_ZONE_NORMAL);
+
+    if (!frame)
+        return NULL;
+
+    kmm_frame_zero(frame);
+
+    return frame;
+}
+
+bool kmm_zero_pool_refill(void)
+{
+    // meant for idle time: zero a small batch, returns whether it did work
+    uint32_t zeroed = 0;
+
+    // the pool never takes frames reclaim would have to win back
+    while (zero_pool_count < KMM_ZERO_POOL_SIZE && zeroed < KMM_ZERO_POOL_BATCH && free_frames > reclaim_watermark)
+    {
+        // never spend DMA frames on the pool
+        uint32_t frame_number = _kmm_frame_alloc(KMM_ZONE_NORMAL, _KMM_PTR_FRAMES);
+
+        if (frame_number == _KMM_INVALID_FRAME)
+            break;
+
+        void* frame = (void*) (frame_number * _KMM_BLOCK_SIZE);
+
+        kmm_frame_zero(frame);
+        frame_descs[(uint32_t)frame / _KMM_BLOCK_SIZE].flags |= KMM_FRAME_ZEROED;
+
+        zero_pool[zero_pool_count++] = frame;
+        zeroed++;
+    }
+
+    return zeroed != 0;
+}
+
+void kmm_zero_pool_drain(void)
+{
+    // give every pooled frame back to the allocator
+    while (zero_pool_count > 0)
+        kmm_frame_free(_kmm_zero_pool_pop());
+}
+
+void kmm_get_zero_pool_stats(kmm_zero_pool_stats_t* stats)
+{
+    if (!stats)
+        return;
+
+    stats->hits = zero_pool_hits;
+    stats->misses = zero_pool_misses;
+    stats->pooled = zero_pool_count;
+}
+
+void kmm_set_reclaim_handler(kmm_reclaim_handler_t handler, uint32_t watermark)
+{
+    reclaim_handler = handler;
+    reclaim_watermark = handler ? watermark : 0;
+}
+
+void kmm_get_zone_stats(uint32_t zone, kmm_zone_stats_t* stats)
+{
+    if (!stats || zone >= KMM_ZONE_COUNT)
+        return;
 
+    stats->start = _kmm_zone_start(zone);
+    stats->end = zone_end[zone];
+    stats->free = zone_free[zone];
 }
 
-#endif
\ No newline at end of file
+#endif
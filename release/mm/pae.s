@@ -0,0 +1,42 @@
+/**
+ * @file pae.s
+ * 
+ * @brief Switch from 32-bit paging to PAE paging. Paging has to be turned
+ * off to change CR4.PAE, so this code is copied to an identity mapped low
+ * page (PAE_TRAMPOLINE_PHYS) and called from there with interrupts off. It
+ * must stay position independent and must not touch the stack while paging
+ * is off.
+ */
+
+.global vmm_pae_trampoline
+.global vmm_pae_trampoline_end
+
+CR0_PG  = 0x80000000                 # paging enable
+CR4_PAE = 0x00000020                 # physical address extension
+
+.type vmm_pae_trampoline, @function
+vmm_pae_trampoline:
+    movl    4(%esp),     %ecx        # physical address of the new PDPT
+
+    # turn paging off, we keep running since this page is identity mapped
+    movl    %cr0,        %eax
+    andl    $~CR0_PG,    %eax
+    movl    %eax,        %cr0
+
+    # enable PAE and load the PDPT
+    movl    %cr4,        %eax
+    orl     $CR4_PAE,    %eax
+    movl    %eax,        %cr4
+    movl    %ecx,        %cr3
+
+    # paging back on, the new tables map this page and the caller
+    movl    %cr0,        %eax
+    orl     $CR0_PG,     %eax
+    movl    %eax,        %cr0
+
+    ret
+
+vmm_pae_trampoline_end:
+
+# no executable stack needed
+.section .note.GNU-stack,"",@progbits
@@ -0,0 +1,140 @@
+#ifndef _SWAP_C
+#define _SWAP_C
+
+#include <mm/swap.h>
+#include <mm/kmm.h>
+#include <log.h>
+
+// first frame of the area (physical), slot i is the i-th frame from here
+static uint8_t* _swap_area = NULL;
+static uint32_t _swap_slots = 0;
+
+// page table entries naming each slot, 0 = free
+static uint16_t _swap_refs[SWAP_SLOTS_MAX];
+
+// where the search for a free slot starts
+static uint32_t _swap_hint = 0;
+
+static swap_stats_t _swap_stats;
+
+static inline void* _swap_slot_frame(uint32_t slot)
+{
+    return _swap_area + (uintptr_t)slot * _KMM_BLOCK_SIZE;
+}
+
+bool swap_init(uint32_t slots)
+{
+    if (slots == 0 || slots > SWAP_SLOTS_MAX)
+        return false;
+
+    // the old area goes first, which it only can while nothing is in it
+    if (!swap_release())
+        return false;
+
+    _swap_area = (uint8_t*) kmm_frames_alloc(slots, 1);
+
+    if (!_swap_area)
+    {
+        LOG_ERROR("swap_init: no room for %u slots\n", slots);
+        return false;
+    }
+
+    // owned by the kernel, like the frames of its image
+    for (uint32_t i = 0; i < slots; i++)
+        kmm_frame_set_flags(_swap_slot_frame(i), KMM_FRAME_KERNEL);
+
+    _swap_slots = slots;
+    _swap_hint = 0;
+
+    memset(_swap_refs, 0, sizeof(_swap_refs));
+    memset(&_swap_stats, 0, sizeof(swap_stats_t));
+
+    _swap_stats.slots = slots;
+
+    return true;
+}
+
+bool swap_release(void)
+{
+    if (!_swap_area)
+        return true;
+
+    if (_swap_stats.used)
+        return false;
+
+    kmm_frames_free(_swap_area, _swap_slots);
+
+    _swap_area = NULL;
+    _swap_slots = 0;
+    _swap_stats.slots = 0;
+
+    return true;
+}
+
+uint32_t swap_slot_alloc(void)
+{
+    if (_swap_stats.used == _swap_slots)
+        return SWAP_NO_SLOT;
+
+    // next fit, from where the last slot was taken
+    for (uint32_t i = 0; i < _swap_slots; i++)
+    {
+        uint32_t slot = (_swap_hint + i) % _swap_slots;
+
+        if (_swap_refs[slot])
+            continue;
+
+        _swap_refs[slot] = 1;
+        _swap_hint = slot + 1;
+        _swap_stats.used++;
+
+        return slot;
+    }
+
+    return SWAP_NO_SLOT;
+}
+
+void swap_slot_get(uint32_t slot)
+{
+    if (slot >= _swap_slots || _swap_refs[slot] == 0)
+        return;
+
+    // saturate instead of wrapping back to zero, the slot then stays taken
+    if (_swap_refs[slot] != (uint16_t)0xFFFF)
+        _swap_refs[slot]++;
+}
+
+void swap_slot_put(uint32_t slot)
+{
+    if (slot >= _swap_slots || _swap_refs[slot] == 0 || _swap_refs[slot] == (uint16_t)0xFFFF)
+        return;
+
+    if (--_swap_refs[slot] == 0)
+        _swap_stats.used--;
+}
+
+void swap_write(uint32_t slot, void* frame_phys)
+{
+    if (slot >= _swap_slots)
+        return;
+
+    kmm_frame_copy(_swap_slot_frame(slot), frame_phys);
+    _swap_stats.writes++;
+}
+
+void swap_read(uint32_t slot, void* frame_phys)
+{
+    if (slot >= _swap_slots)
+        return;
+
+    kmm_frame_copy(frame_phys, _swap_slot_frame(slot));
+    _swap_stats.reads++;
+}
+
+void swap_get_stats(swap_stats_t* stats)
+{
+    if (stats)
+        *stats = _swap_stats;
+}
+
+#endif
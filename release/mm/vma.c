@@ -0,0 +1,548 @@
+#ifndef _VMA_C
+#define _VMA_C
+
+#include <mm/vma.h>
+#include <mm/kheap.h>
+#include <string.h>
+#include <log.h>
+
+// address spaces with VMAs, chained per bucket
+static vma_space_t* _vma_spaces[VMA_SPACE_BUCKETS];
+
+// spaces and VMA nodes taken from the heap and not given back yet
+static uint32_t _vma_space_count = 0;
+static uint32_t _vma_node_count = 0;
+
+static inline uint32_t _vma_bucket(pagedir_t* pdir)
+{
+    return (uint32_t)(((uintptr_t)pdir / VMM_PAGE_SIZE) % VMA_SPACE_BUCKETS);
+}
+
+static inline uint8_t _vma_height(vma_t* node)
+{
+    return node ? node->height : 0;
+}
+
+static inline uintptr_t _vma_max(uintptr_t a, uintptr_t b)
+{
+    return (a > b) ? a : b;
+}
+
+// recomputes the height and the gap search fields of 'node' from its children
+static void _vma_update(vma_t* node)
+{
+    uint8_t left_height = _vma_height(node->left);
+    uint8_t right_height = _vma_height(node->right);
+
+    node->height = 1 + ((left_height > right_height) ? left_height : right_height);
+
+    node->min_start = node->left ? node->left->min_start : node->start;
+    node->max_end = node->right ? node->right->max_end : node->end;
+
+    // the VMA right before this one is the last of the left subtree, the one
+    // right after it the first of the right subtree
+    uintptr_t gap = 0;
+
+    if (node->left)
+        gap = _vma_max(node->left->subtree_gap, node->start - node->left->max_end);
+
+    if (node->right)
+        gap = _vma_max(gap, _vma_max(node->right->subtree_gap, node->right->min_start - node->end));
+
+    node->subtree_gap = gap;
+}
+
+static vma_t* _vma_rotate_right(vma_t* node)
+{
+    vma_t* pivot = node->left;
+
+    node->left = pivot->right;
+    pivot->right = node;
+
+    _vma_update(node);
+    _vma_update(pivot);
+
+    return pivot;
+}
+
+static vma_t* _vma_rotate_left(vma_t* node)
+{
+    vma_t* pivot = node->right;
+
+    node->right = pivot->left;
+    pivot->left = node;
+
+    _vma_update(node);
+    _vma_update(pivot);
+
+    return pivot;
+}
+
+// restores the AVL balance of 'node' once one of its subtrees changed
+// height by one, returns the new subtree root
+static vma_t* _vma_balance(vma_t* node)
+{
+    _vma_update(node);
+
+    int32_t balance = (int32_t)_vma_height(node->left) - (int32_t)_vma_height(node->right);
+
+    if (balance > 1)
+    {
+        if (_vma_height(node->left->left) < _vma_height(node->left->right))
+            node->left = _vma_rotate_left(node->left);
+
+        return _vma_rotate_right(node);
+    }
+
+    if (balance < -1)
+    {
+        if (_vma_height(node->right->right) < _vma_height(node->right->left))
+            node->right = _vma_rotate_right(node->right);
+
+        return _vma_rotate_left(node);
+    }
+
+    return node;
+}
+
+static vma_t* _vma_insert_node(vma_t* root, vma_t* node)
+{
+    if (!root)
+        return node;
+
+    if (node->start < root->start)
+        root->left = _vma_insert_node(root->left, node);
+    else
+        root->right = _vma_insert_node(root->right, node);
+
+    return _vma_balance(root);
+}
+
+// unlinks the first VMA of the subtree 'root' into 'first'
+static vma_t* _vma_remove_first(vma_t* root, vma_t** first)
+{
+    if (!root->left)
+    {
+        *first = root;
+        return root->right;
+    }
+
+    root->left = _vma_remove_first(root->left, first);
+
+    return _vma_balance(root);
+}
+
+// unlinks 'node' from the subtree 'root' (start addresses are unique)
+static vma_t* _vma_remove_node(vma_t* root, vma_t* node)
+{
+    if (!root)
+        return NULL;
+
+    if (node->start < root->start)
+        root->left = _vma_remove_node(root->left, node);
+
+    else if (node->start > root->start)
+        root->right = _vma_remove_node(root->right, node);
+
+    else
+    {
+        vma_t* left = root->left;
+        vma_t* right = root->right;
+
+        if (!right)
+            return left;
+
+        // the next VMA takes this one's place
+        vma_t* next;
+        right = _vma_remove_first(right, &next);
+
+        next->left = left;
+        next->right = right;
+
+        return _vma_balance(next);
+    }
+
+    return _vma_balance(root);
+}
+
+static vma_t* _vma_alloc(uintptr_t start, uintptr_t end, uint32_t flags, uint8_t backing)
+{
+    vma_t* node = (vma_t*) kmalloc(get_kernel_heap(), sizeof(vma_t));
+
+    if (!node)
+        return NULL;
+
+    _vma_node_count++;
+
+    memset(node, 0, sizeof(vma_t));
+
+    node->start = start;
+    node->end = end;
+    node->flags = flags;
+    node->backing = backing;
+
+    _vma_update(node);
+
+    return node;
+}
+
+static void _vma_free(vma_t* node)
+{
+    kfree(get_kernel_heap(), node);
+    _vma_node_count--;
+}
+
+static void _vma_free_tree(vma_t* node)
+{
+    if (!node)
+        return;
+
+    _vma_free_tree(node->left);
+    _vma_free_tree(node->right);
+
+    _vma_free(node);
+}
+
+// copies the subtree 'node' as it is (same shape, so no rebalancing).
+// clears 'ok' when the heap runs out, the copy is then partial
+static vma_t* _vma_copy_tree(vma_t* node, bool* ok)
+{
+    if (!node || !*ok)
+        return NULL;
+
+    vma_t* copy = (vma_t*) kmalloc(get_kernel_heap(), sizeof(vma_t));
+
+    if (!copy)
+    {
+        *ok = false;
+        return NULL;
+    }
+
+    _vma_node_count++;
+
+    *copy = *node;
+
+    copy->left = _vma_copy_tree(node->left, ok);
+    copy->right = _vma_copy_tree(node->right, ok);
+
+    return copy;
+}
+
+// some VMA of the subtree 'node' overlapping [start, end), NULL if none
+static vma_t* _vma_overlap(vma_t* node, uintptr_t start, uintptr_t end)
+{
+    while (node)
+    {
+        if (node->end > start && node->start < end)
+            return node;
+
+        node = (end <= node->start) ? node->left : node->right;
+    }
+
+    return NULL;
+}
+
+// start of 'size' bytes inside both [gap_start, gap_end) and [low, high), 0 if they do not fit
+static inline uintptr_t _vma_fit(uintptr_t gap_start, uintptr_t gap_end, uintptr_t low, uintptr_t high, size_t size)
+{
+    uintptr_t start = (gap_start > low) ? gap_start : low;
+    uintptr_t end = (gap_end < high) ? gap_end : high;
+
+    return (end > start && end - start >= size) ? start : 0;
+}
+
+// lowest fit between two VMAs of the subtree 'node'. subtrees whose largest
+// gap is too small or that lie outside [low, high) are skipped
+static uintptr_t _vma_gap_in(vma_t* node, uintptr_t low, uintptr_t high, size_t size)
+{
+    if (!node || node->subtree_gap < size || node->max_end <= low || node->min_start >= high)
+        return 0;
+
+    uintptr_t addr = _vma_gap_in(node->left, low, high, size);
+
+    if (!addr && node->left)
+        addr = _vma_fit(node->left->max_end, node->start, low, high, size);
+
+    if (!addr && node->right)
+        addr = _vma_fit(node->end, node->right->min_start, low, high, size);
+
+    if (!addr)
+        addr = _vma_gap_in(node->right, low, high, size);
+
+    return addr;
+}
+
+void vma_init(void)
+{
+    // a second init comes with a new kernel heap, the old spaces are gone with it
+    memset(_vma_spaces, 0, sizeof(_vma_spaces));
+
+    _vma_space_count = 0;
+    _vma_node_count = 0;
+}
+
+vma_space_t* vma_space_get(pagedir_t* pdir, bool create)
+{
+    if (!pdir)
+        return NULL;
+
+    uint32_t bucket = _vma_bucket(pdir);
+
+    for (vma_space_t* space = _vma_spaces[bucket]; space; space = space->next)
+    {
+        if (space->pdir == pdir)
+            return space;
+    }
+
+    if (!create)
+        return NULL;
+
+    vma_space_t* space = (vma_space_t*) kmalloc(get_kernel_heap(), sizeof(vma_space_t));
+
+    if (!space)
+    {
+        LOG_ERROR("vma_space_get: out of heap memory\n");
+        return NULL;
+    }
+
+    space->pdir = pdir;
+    space->root = NULL;
+    space->count = 0;
+    space->next = _vma_spaces[bucket];
+
+    memset(&space->ws, 0, sizeof(vmm_ws_stats_t));
+
+    _vma_spaces[bucket] = space;
+    _vma_space_count++;
+
+    return space;
+}
+
+vma_space_t* vma_space_next(vma_space_t* space)
+{
+    // the rest of the bucket, then the following buckets
+    if (space && space->next)
+        return space->next;
+
+    for (uint32_t bucket = space ? _vma_bucket(space->pdir) + 1 : 0; bucket < VMA_SPACE_BUCKETS; bucket++)
+    {
+        if (_vma_spaces[bucket])
+            return _vma_spaces[bucket];
+    }
+
+    return NULL;
+}
+
+void vma_space_destroy(pagedir_t* pdir)
+{
+    if (!pdir)
+        return;
+
+    vma_space_t** link = &_vma_spaces[_vma_bucket(pdir)];
+
+    while (*link && (*link)->pdir != pdir)
+        link = &(*link)->next;
+
+    vma_space_t* space = *link;
+
+    if (!space)
+        return;
+
+    *link = space->next;
+
+    _vma_free_tree(space->root);
+    kfree(get_kernel_heap(), space);
+
+    _vma_space_count--;
+}
+
+bool vma_space_clone(pagedir_t* src, pagedir_t* dst)
+{
+    vma_space_t* src_space = vma_space_get(src, false);
+
+    // nothing reserved, nothing to copy
+    if (!src_space || !src_space->root)
+        return true;
+
+    vma_space_t* dst_space = vma_space_get(dst, true);
+
+    if (!dst_space)
+        return false;
+
+    bool ok = true;
+    vma_t* copy = _vma_copy_tree(src_space->root, &ok);
+
+    if (!ok)
+    {
+        _vma_free_tree(copy);
+        LOG_ERROR("vma_space_clone: out of heap memory\n");
+        return false;
+    }
+
+    _vma_free_tree(dst_space->root);
+
+    dst_space->root = copy;
+    dst_space->count = src_space->count;
+
+    return true;
+}
+
+vma_t* vma_find(vma_space_t* space, uintptr_t addr)
+{
+    vma_t* node = space ? space->root : NULL;
+
+    while (node)
+    {
+        if (addr < node->start)
+            node = node->left;
+
+        else if (addr >= node->end)
+            node = node->right;
+
+        else
+            return node;
+    }
+
+    return NULL;
+}
+
+vma_t* vma_next(vma_space_t* space, uintptr_t addr)
+{
+    // VMAs do not overlap, so ends are ordered like starts: the lowest VMA
+    // ending above 'addr'
+    vma_t* node = space ? space->root : NULL;
+    vma_t* next = NULL;
+
+    while (node)
+    {
+        if (node->end > addr)
+        {
+            next = node;
+            node = node->left;
+        }
+        else
+            node = node->right;
+    }
+
+    return next;
+}
+
+bool vma_insert(vma_space_t* space, uintptr_t start, uintptr_t end, uint32_t flags, uint8_t backing)
+{
+    if (!space || start >= end)
+        return false;
+
+    vma_t* node = _vma_alloc(start, end, flags, backing);
+
+    if (!node)
+    {
+        LOG_ERROR("vma_insert: out of heap memory\n");
+        return false;
+    }
+
+    // whatever was reserved in the range before is replaced. the removal only
+    // fails when it would split a VMA, before anything changed
+    if (!vma_remove_range(space, start, end))
+    {
+        _vma_free(node);
+        return false;
+    }
+
+    space->root = _vma_insert_node(space->root, node);
+    space->count++;
+
+    return true;
+}
+
+bool vma_remove_range(vma_space_t* space, uintptr_t start, uintptr_t end)
+{
+    if (!space || start >= end)
+        return false;
+
+    vma_t* vma;
+
+    while ((vma = _vma_overlap(space->root, start, end)) != NULL)
+    {
+        bool keep_head = vma->start < start;
+        bool keep_tail = vma->end > end;
+
+        // a range inside the VMA splits it, the tail needs a node of its own
+        vma_t* tail = NULL;
+
+        if (keep_head && keep_tail)
+        {
+            tail = _vma_alloc(end, vma->end, vma->flags, vma->backing);
+
+            if (!tail)
+            {
+                LOG_ERROR("vma_remove_range: out of heap memory\n");
+                return false;
+            }
+        }
+
+        // the bounds change, so the VMA goes out of the tree and back in
+        space->root = _vma_remove_node(space->root, vma);
+        space->count--;
+
+        if (tail)
+        {
+            space->root = _vma_insert_node(space->root, tail);
+            space->count++;
+        }
+
+        if (keep_head)
+            vma->end = start;
+
+        else if (keep_tail && !tail)
+            vma->start = end;
+
+        else if (!keep_head)
+        {
+            _vma_free(vma);
+            continue;
+        }
+
+        vma->left = NULL;
+        vma->right = NULL;
+
+        _vma_update(vma);
+
+        space->root = _vma_insert_node(space->root, vma);
+        space->count++;
+    }
+
+    return true;
+}
+
+void vma_get_counts(uint32_t* spaces, uint32_t* vmas)
+{
+    if (spaces)
+        *spaces = _vma_space_count;
+
+    if (vmas)
+        *vmas = _vma_node_count;
+}
+
+uintptr_t vma_find_gap(vma_space_t* space, uintptr_t low, uintptr_t high, size_t size)
+{
+    vma_t* root = space ? space->root : NULL;
+
+    if (size == 0 || low >= high)
+        return 0;
+
+    if (!root)
+        return _vma_fit(low, high, low, high, size);
+
+    // before the first VMA, between two of them, after the last one
+    uintptr_t addr = _vma_fit(low, root->min_start, low, high, size);
+
+    if (!addr)
+        addr = _vma_gap_in(root, low, high, size);
+
+    if (!addr)
+        addr = _vma_fit(root->max_end, high, low, high, size);
+
+    return addr;
+}
+
+#endif
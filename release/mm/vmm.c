@@ -2,11 +2,98 @@
 #define _VMM_C
 
 #include <mm/vmm.h>
+#include <mm/vma.h>
+#include <mm/swap.h>
+#include <utils.h>
 
 // global state variables
 static pagedir_t* _vmm_current_pagedir = NULL;
 static pagedir_t* _vmm_kernel_pagedir = NULL;
 
+// set once CR4.PGE is on, kernel-half mappings are global from then on
+static bool _vmm_global_pages = false;
+
+// set once CR4.PSE is on, vmm_map_range uses large pages where it can
+static bool _vmm_large_pages = false;
+
+// TSC cycles vmm_init spent on the identity map and the physmap
+static uint64_t _vmm_boot_map_cycles = 0;
+
+// set once the kernel-half PDEs are final, new address spaces copy them
+static bool _vmm_kernel_template_ready = false;
+
+// fault counters, a slot is claimed by an address space on its first fault
+static struct {
+    pagedir_t*          pdir;
+    vmm_fault_stats_t   stats;
+} _vmm_fault_slots[VMM_FAULT_STAT_SLOTS];
+
+// page fault resolvers, tried in registration order
+static struct {
+    const char*             name;
+    vmm_fault_resolver_t    resolver;
+} _vmm_fault_resolvers[VMM_FAULT_RESOLVERS_MAX];
+
+static uint32_t _vmm_fault_resolver_count = 0;
+
+// translation caches, a slot is claimed by an address space on its first lookup
+typedef struct {
+    pagedir_t*      pdir;
+    uint32_t        epoch;
+
+    struct {
+        uint32_t    tag;        // page number + 1, 0 when empty
+        phys_addr_t frame;
+    } entries[VMM_XLATE_ENTRIES];
+} vmm_xlate_cache_t;
+
+static vmm_xlate_cache_t _vmm_xlate_slots[VMM_XLATE_SLOTS];
+static vmm_xlate_cache_t* _vmm_xlate_last = NULL;
+
+// bumped to drop every cached translation at once
+static uint32_t _vmm_xlate_epoch = 0;
+
+static vmm_xlate_stats_t _vmm_xlate_stats;
+
+static vmm_fault_summary_t _vmm_fault_summary;
+
+// queued invalidations up to this count are done page by page
+static uint32_t _vmm_tlb_flush_threshold = VMM_TLB_FLUSH_THRESHOLD;
+
+// TSC at the last working-set pass of the idle loop
+static uint64_t _vmm_ws_last_idle_scan = 0;
+
+// clock hand of the reclaimer: the address space and the address it stopped at
+static pagedir_t* _vmm_reclaim_pdir = NULL;
+static uintptr_t _vmm_reclaim_addr = 0;
+
+static vmm_swap_stats_t _vmm_swap_stats;
+
+// zeroed frame every read of a lazy page maps read-only, never freed
+static void* _vmm_zero_frame = NULL;
+
+static bool _vmm_resolve_lazy(pagedir_t* pdir, uintptr_t virtual, uint32_t error_code);
+static bool _vmm_resolve_cow(pagedir_t* pdir, uintptr_t virtual, uint32_t error_code);
+static bool _vmm_resolve_guard(pagedir_t* pdir, uintptr_t virtual, uint32_t error_code);
+static bool _vmm_resolve_swap(pagedir_t* pdir, uintptr_t virtual, uint32_t error_code);
+static uint32_t _vmm_reclaim_frames(uint32_t frames);
+static pte_t* _vmm_find_pte(pagedir_t* pdir, uintptr_t virtual);
+static void _vmm_flush_tlb_all(bool global);
+
+#ifdef VMM_RECURSIVE
+// set while the loaded directory is one of ours, all of them map themselves
+static bool _vmm_recursive_loaded = false;
+#endif
+
+#ifdef VMM_PAE
+// set once the first PAE address space is loaded (the boot tables are 32-bit)
+static bool _vmm_pae_active = false;
+
+// PAE switch code (mm/pae.s), copied to PAE_TRAMPOLINE_PHYS before use
+extern uint8_t vmm_pae_trampoline[];
+extern uint8_t vmm_pae_trampoline_end[];
+#endif
+
 // NOTE: page directories and tables MUST BE accessed through physmap
 
 // Helper function to validate physical frame address
@@ -20,651 +107,2776 @@ static inline bool _vmm_is_valid_frame(void* frame_phys)
         return false;
     
     // Check bounds: frame must be within valid physical memory range
-    uint32_t max_phys_addr = kmm_get_total_frames() * VMM_PAGE_SIZE;
-    if ((uintptr_t)frame_phys >= max_phys_addr)
+    if ((uintptr_t)frame_phys / VMM_PAGE_SIZE >= kmm_get_total_frames())
         return false;
     
     return true;
 }
 
-void vmm_init(void)
+// records a freshly allocated data frame as mapped once by a PTE
+static inline void _vmm_track_frame(void* frame_phys, uint32_t flags)
 {
-    LOG_DEBUG("------------------------------\n");
-    LOG_DEBUG("VMM INIT\n");
-
-    // register page fault interrupt handler
-    register_interrupt_handler(PAGE_FAULT_INTERRUPT, _vmm_page_fault_handler);
-
-    // create new address space for the kernel
-    pagedir_t* kernel_addr_space = vmm_create_address_space();
+    frame_desc_t* desc = kmm_frame_desc(frame_phys);
 
-    // sanity check
-    if (!kernel_addr_space)
+    if (!desc)
         return;
 
-    // set kernel_pagedir
-    LOG_DEBUG("Set kernel page directory: 0x%08x\n", (uint32_t)kernel_addr_space);
-    _vmm_kernel_pagedir = kernel_addr_space; 
-
-    // set up identity mapping for first 1MB of physical memory (map each 4KB page with virtual address equal to physical address)
-    LOG_DEBUG("Setting up identity mapping...\n");
-    for (uint32_t identity_i = 0x0; identity_i < 0x100000; identity_i += 0x1000)
-    {
-        // for each 4KB virtual region (page), map it into a page frame
-        vmm_map_page(kernel_addr_space, (void*)identity_i, (void*)identity_i, PTE_PRESENT | PTE_WRITABLE);
-    }
-    
-    // set up physmap (map all available physical memory starting at PHYSMAP_BASE (3GB))
-    uint32_t total_frames = kmm_get_total_frames();
-    uint32_t max_phys_addr = total_frames * VMM_PAGE_SIZE;
-    
-    
-    LOG_DEBUG("Setting up physmap...\n");
-    for (uint32_t phys = 0; phys < max_phys_addr; phys += VMM_PAGE_SIZE)
-    { 
-        // convert this physical address to a virtual one
-        void* virt = (void*) PHYS_TO_VIRT(phys);
-        // LOG_DEBUG("Virt: 0x%08x\n", virt);
-
-        // vmm_create_pt(kernel_addr_space, (void*)virt, PDE_PRESENT| PDE_WRITABLE);
-
-        // map this page onto a frame
-        vmm_map_page(kernel_addr_space, (void*)virt, (void*)phys, PTE_PRESENT | PTE_WRITABLE);
-    }
+    desc->mapcount = 1;
 
-    // THIS DOES NOT PRINT OUT!
-    // switch to the newly created kernel page directory
-    LOG_DEBUG("Switching to kernel space...\n");
-    vmm_switch_pagedir(kernel_addr_space);
+    if (flags & PTE_USER)
+        desc->flags |= KMM_FRAME_USER;
+}
 
-    kmm_print_status();
+// the kernel heap is lazy: its frames are tagged as heap owned where a fault
+// creates them, so reclaim leaves them alone
+static inline void _vmm_tag_heap_frame(void* frame_phys, uintptr_t virtual)
+{
+    if (virtual >= KERNEL_HEAP_VIRT && virtual - KERNEL_HEAP_VIRT < KERNEL_HEAP_SIZE)
+        kmm_frame_set_flags(frame_phys, KMM_FRAME_HEAP);
+}
 
+// present entries and reserved markers both keep their page table alive
+static inline bool _vmm_pte_in_use(pte_t pte)
+{
+    return (pte & (PTE_PRESENT | VMM_PTE_RESERVED)) != 0;
 }
 
-pagedir_t* vmm_create_address_space(void)
+// not-present entry of a page in swap slot 'slot', mapped with 'flags' once back
+static inline pte_t _vmm_swap_entry(uint32_t slot, uint32_t flags)
 {
-    // allocate a physical frame
-    void* frame_phys_addr = kmm_frame_alloc();
+    return ((pte_t)slot * VMM_PAGE_SIZE) | (flags & ~(PTE_PRESENT | PTE_ACCESSED | PTE_DIRTY)) | PTE_SWAPPED;
+}
 
-    if (!frame_phys_addr)
-        return NULL;
+static inline uint32_t _vmm_swap_slot(pte_t pte)
+{
+    return (uint32_t)(PTE_FRAME_ADDR(pte) / VMM_PAGE_SIZE);
+}
 
-    // for page tables and dirs to access this frame, need to convert it into virtual address
-    pagedir_t* pagedir_addr = PHYS_TO_VIRT(frame_phys_addr);
+// a swap entry that is copied holds on to its slot too
+static inline void _vmm_swap_share(pte_t pte)
+{
+    if (!PTE_IS_PRESENT(pte) && (pte & PTE_SWAPPED))
+        swap_slot_get(_vmm_swap_slot(pte));
+}
 
-    // clear out the page directory / address space
-    memset(pagedir_addr, 0, sizeof(pagedir_t));
+// a swap entry that is dropped lets go of its slot
+static inline void _vmm_swap_drop(pte_t pte)
+{
+    if (!PTE_IS_PRESENT(pte) && (pte & PTE_SWAPPED))
+        swap_slot_put(_vmm_swap_slot(pte));
+}
 
-    return pagedir_addr;
+// true when the entries of 'pdir' can be reached through the recursive
+// mapping, i.e. it is the loaded address space
+static inline bool _vmm_recursive_current(pagedir_t* pdir)
+{
+#ifdef VMM_RECURSIVE
+    return _vmm_recursive_loaded && pdir == _vmm_current_pagedir;
+#else
+    (void)pdir;
+    return false;
+#endif
 }
 
-void vmm_map_page(pagedir_t* pdir, void* virtual, void* physical, uint32_t flags)
+// physical frame of the page table 'pte' belongs to. tables are accessed
+// through physmap, or through the recursive mapping for the loaded space
+// where the PDE of the addresses the entry covers names the table
+static inline void* _vmm_pte_table(pte_t* pte)
 {
-    // TODO: validate if pdir exists
-    if (!pdir)
+#ifdef VMM_RECURSIVE
+    if ((uintptr_t)pte >= VMM_RECURSIVE_BASE)
     {
-        LOG_ERROR("Page directory is NULL!\n");
-        return;
-    }
-
-    // ensure a page table exists for the virtual address
-    // done by accessing the PD_index
-    uint32_t pagedir_i = VMM_DIR_INDEX(virtual);
+        uintptr_t virtual = ((uintptr_t)pte - VMM_RECURSIVE_BASE) / sizeof(pte_t) * VMM_PAGE_SIZE;
 
-    pde_t pde = pdir->table[pagedir_i];
-
-    // Create page table if needed
-    if (!PDE_IS_PRESENT(pde))
-    {
-        vmm_create_pt(pdir, virtual, PDE_PRESENT | PDE_WRITABLE);
-        
-        // re-read PDE after creation
-        pde = pdir->table[pagedir_i];
-        
-        if (!PDE_IS_PRESENT(pde))
-        {
-            LOG_ERROR("ERROR: Failed to create page table for virt 0x%08x\n", (uint32_t)virtual);
-            return;
-        }
+        return (void*)(uintptr_t)PDE_PTABLE_ADDR(*VMM_RECURSIVE_PDE(virtual));
     }
+#endif
 
-    // page table now exists, read again and extract physical address
-    pde = pdir->table[pagedir_i];
-
-    uint32_t pagetable_phys_addr = (uint32_t) PDE_PTABLE_ADDR(pde);
-
-    // convert to virtual address for dereferencing
-    pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT(pagetable_phys_addr);
+    return VIRT_TO_PHYS((uintptr_t)pte & ~(uintptr_t)(VMM_PAGE_SIZE - 1));
+}
 
-    // locate appropriate entry within the page table
-    // get the page table index from original address
-    uint32_t pagetable_i = VMM_TABLE_INDEX(virtual);
+// adds 'delta' to the entries-in-use count of the table 'pte' is in. the
+// count lives in the descriptor of the table frame
+static inline void _vmm_count_ptes(pte_t* pte, int32_t delta)
+{
+    if (!delta)
+        return;
 
-    // get page table entry
-    pte_t* pte = &(ptable->table[pagetable_i]);
+    frame_desc_t* desc = kmm_frame_desc(_vmm_pte_table(pte));
 
-    // create mapping
-    pte_t new_pte = _pte_create(physical, flags);
+    if (desc && (desc->flags & KMM_FRAME_PAGETABLE))
+        desc->pte_count += delta;
+}
 
-    // assign to entry
-    *pte = new_pte;
+// writes a PTE and keeps the entries-in-use count of its table up to date
+static inline void _vmm_set_pte(pte_t* pte, pte_t value)
+{
+    _vmm_count_ptes(pte, (int32_t)_vmm_pte_in_use(value) - (int32_t)_vmm_pte_in_use(*pte));
 
-    // TODO: flush TLB????
+    *pte = value;
 }
 
-void vmm_create_pt(pagedir_t* pdir, void* virtual, uint32_t flags)
+// entries in use in 'ptable', 0 once it can be freed
+static inline uint32_t _vmm_pt_used(pagetable_t* ptable)
 {
-    // LOG_DEBUG("Inside create_pt!\n");
-    // LOG_DEBUG("Inside create_pt!\n");
-    // LOG_DEBUG("Inside create_pt!\n");
-    // LOG_DEBUG("Inside create_pt!\n");
-
-    if (!pdir)
-    {
-        // LOG_ERROR("PDIR DOES NOT EXIST!\n");
-        return;
-    }
+    frame_desc_t* desc = kmm_frame_desc(VIRT_TO_PHYS(ptable));
 
-    // determine which dir entry corresponding to virtual address
-    uint32_t pagedir_i = VMM_DIR_INDEX(virtual);
+    return desc ? desc->pte_count : 0;
+}
 
-    pde_t* pde = &(pdir->table[pagedir_i]);
+// flags for a mapping at 'virtual': kernel-half mappings survive CR3 loads
+// once PGE is on, user mappings are never global
+static inline uint32_t _vmm_page_flags(uintptr_t virtual, uint32_t flags)
+{
+    if ((flags & PTE_USER) || virtual < VMM_KERNEL_BASE)
+        return flags & ~PTE_GLOBAL;
 
-    // check if page table already exists
-    if (PDE_IS_PRESENT(*pde))
-        return;
-    
-    // table does not exist
-    // allocate and init new page table
-    // LOG_DEBUG("Calling kmm_frame_alloc\n");
-    void* table_frame_addr = kmm_frame_alloc();
-    // LOG_DEBUG("Outside kmm_frame_alloc\n");
-    
-    // convert to virtual for memset
-    void* table_frame_virt_addr = (void*) PHYS_TO_VIRT(table_frame_addr);
-    
-    // clear the frame
-    // LOG_DEBUG("Before memset\n");
-    memset(table_frame_virt_addr, 0, sizeof(pagetable_t));
-    // LOG_DEBUG("After memset\n");
-    
-    // update page dir to reference new table
-    pde_t new_entry = _pde_create(table_frame_addr, flags);
+    if (_vmm_global_pages)
+        flags |= PTE_GLOBAL;
 
-    *pde = new_entry;
+    return flags;
 }
 
-
-// TODO: implement handler
-void _vmm_page_fault_handler(interrupt_context_t* ctx)
+// starts a new address space with the kernel half of the kernel directory,
+// one copy of VMM_KERNEL_PDE_END - VMM_KERNEL_PDE_FIRST entries (about 1KB,
+// 4KB with PAE). nothing to copy while the kernel directory itself is built
+static inline void _vmm_copy_kernel_pdes(pagedir_t* pdir)
 {
-    LOG_ERROR("PAGE FAULT!!!");
-
-    // while (1)
-    //     asm volatile ("hlt" :::);
-}
+#ifdef VMM_RECURSIVE
+    // the last PDEs map the directories themselves, never global
+    for (uint32_t i = 0; i < VMM_RECURSIVE_DIRS; i++)
+        pdir->table[VMM_RECURSIVE_PDE_FIRST + i] = _pde_create(VIRT_TO_PHYS(&pdir->table[i * VMM_PAGES_PER_TABLE]),
+                                                               PDE_PRESENT | PDE_WRITABLE);
+#endif
 
+    if (!_vmm_kernel_template_ready)
+        return;
 
-pagedir_t* vmm_get_kerneldir(void)
-{
-    return _vmm_kernel_pagedir;
+    memcpy(&pdir->table[VMM_KERNEL_PDE_FIRST], &_vmm_kernel_pagedir->table[VMM_KERNEL_PDE_FIRST],
+           (VMM_KERNEL_PDE_END - VMM_KERNEL_PDE_FIRST) * sizeof(pde_t));
 }
 
-pagedir_t* vmm_get_current_pagedir(void)
+// a new directory may reuse the address of a freed one, its counters start over
+static inline void _vmm_forget_fault_stats(pagedir_t* pdir)
 {
-    return _vmm_current_pagedir;
+    for (uint32_t i = 0; i < VMM_FAULT_STAT_SLOTS; i++)
+    {
+        if (_vmm_fault_slots[i].pdir == pdir)
+            _vmm_fault_slots[i].pdir = NULL;
+    }
 }
 
-void* vmm_get_phys_frame(pagedir_t* pdir, void* virtual)
+// translation cache of 'pdir', claimed when 'create' is set (when every slot
+// is taken, the one picked by the directory's address is taken over).
+// entries from before the last epoch bump are dropped on the way
+static vmm_xlate_cache_t* _vmm_xlate_cache(pagedir_t* pdir, bool create)
 {
-    // validate addresses
-    if (!pdir || !virtual) 
-        return NULL;
-
-
-    // get page dir entry
-    uint32_t pagedir_i = VMM_DIR_INDEX(virtual);
+    vmm_xlate_cache_t* cache = _vmm_xlate_last;
 
-    pde_t pde = pdir->table[pagedir_i];
-
-    // check if ptable exists
-    if (!PDE_IS_PRESENT(pde))
-        return NULL;
+    if (!cache || cache->pdir != pdir)
+    {
+        cache = NULL;
+        int32_t free_slot = -1;
 
+        for (uint32_t i = 0; i < VMM_XLATE_SLOTS; i++)
+        {
+            if (_vmm_xlate_slots[i].pdir == pdir)
+            {
+                cache = &_vmm_xlate_slots[i];
+                break;
+            }
 
-    // get page table
-    uint32_t pagetable_phys_addr = (uint32_t) PDE_PTABLE_ADDR(pde);
+            if (free_slot < 0 && !_vmm_xlate_slots[i].pdir)
+                free_slot = (int32_t)i;
+        }
 
-    pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT(pagetable_phys_addr);
+        if (!cache)
+        {
+            if (!create)
+                return NULL;
 
-    // find page table entry
-    uint32_t pagetable_i = VMM_TABLE_INDEX(virtual);
+            if (free_slot < 0)
+                free_slot = (int32_t)(((uintptr_t)pdir / VMM_PAGE_SIZE) % VMM_XLATE_SLOTS);
 
-    pte_t pte = ptable->table[pagetable_i];
+            cache = &_vmm_xlate_slots[free_slot];
+            cache->pdir = pdir;
+            cache->epoch = _vmm_xlate_epoch - 1;
+        }
 
-    // check if entry is present
-    if (!PTE_IS_PRESENT(pte))
-        return NULL;
+        _vmm_xlate_last = cache;
+    }
 
+    if (cache->epoch != _vmm_xlate_epoch)
+    {
+        memset(cache->entries, 0, sizeof(cache->entries));
+        cache->epoch = _vmm_xlate_epoch;
+    }
 
-    // get physical frame address
-    void* frame_phys_addr = (void*) PTE_FRAME_ADDR(pte);
-    
-    return frame_phys_addr;
+    return cache;
 }
 
-int32_t vmm_page_alloc(pte_t* pte, uint32_t flags)
+// drops the cached translations of 'pages' pages from 'virtual' in 'pdir'.
+// kernel-half mappings are shared by every address space, changing one
+// drops every cache
+static void _vmm_xlate_forget(pagedir_t* pdir, uintptr_t virtual, uint32_t pages)
 {
-    // validate PTE pointer
-    // if PTE is present, return 0
-    if (!pte)
-    {
-        // LOG_ERROR("vmm_page_alloc: PTE is NULL!\n");
-        return -1;
-    }
-    
-    // check if the entry already has an allocated frame
-    if (PTE_IS_PRESENT(*pte))
+    if (virtual >= VMM_KERNEL_BASE || pages > (VMM_KERNEL_BASE - virtual) / VMM_PAGE_SIZE)
     {
-        // LOG_ERROR("vmm_page_alloc: PTE already present!\n");
-        return 0;
+        _vmm_xlate_epoch++;
+        return;
     }
 
-    // allocate a new physical frame and create a PTE to reference it
-    void* frame_physical_addr = kmm_frame_alloc();
+    vmm_xlate_cache_t* cache = _vmm_xlate_cache(pdir, false);
 
-    // check if OOM
-    if (!frame_physical_addr)
+    if (!cache)
+        return;
+
+    if (pages >= VMM_XLATE_ENTRIES)
     {
-        // LOG_ERROR("vmm_page_alloc: Out of memory!\n");
-        return -1;
+        memset(cache->entries, 0, sizeof(cache->entries));
+        return;
     }
 
-    // create PTE for the frame
-    pte_t new_entry = _pte_create(frame_physical_addr, flags);
+    uint32_t vpn = virtual / VMM_PAGE_SIZE;
 
-    *pte = new_entry;
+    for (uint32_t i = 0; i < pages; i++, vpn++)
+    {
+        if (cache->entries[vpn % VMM_XLATE_ENTRIES].tag == vpn + 1)
+            cache->entries[vpn % VMM_XLATE_ENTRIES].tag = 0;
+    }
+}
 
-    return 0;
+// a new directory may reuse the address of a freed one, its cache goes
+static inline void _vmm_forget_xlate_cache(pagedir_t* pdir)
+{
+    vmm_xlate_cache_t* cache = _vmm_xlate_cache(pdir, false);
 
+    if (cache)
+        cache->pdir = NULL;
 }
 
-void vmm_page_free(pte_t* pte)
+// true for a present PTE mapping the shared zero frame
+static inline bool _vmm_is_zero_page(pte_t pte)
 {
-    // validate PTE
-    if (!pte)
-    {
-        // LOG_ERROR("vmm_page_free: PTE is NULL!\n");
-        return;
-    }
-
-    // check if PTE does not exist
-    if (!PTE_IS_PRESENT(*pte))
-    {
-        // LOG_ERROR("vmm_page_free: PTE is not present!");
-        return;
-    }
+    return _vmm_zero_frame && PTE_IS_PRESENT(pte) &&
+           PTE_FRAME_ADDR(pte) == (uintptr_t)_vmm_zero_frame;
+}
 
-    // get physical frame address
-    void* frame_physical_addr = (void*)PTE_FRAME_ADDR(*pte);
+// frames mapped more than once (copy-on-write shares) only lose a reference.
+// returns false when the frame is not shared and the caller frees it
+static inline bool _vmm_unshare_frame(phys_addr_t frame_phys)
+{
+    // the zero frame is shared by everyone and never freed
+    if (_vmm_zero_frame && frame_phys == (uintptr_t)_vmm_zero_frame)
+        return true;
 
-    if (!frame_physical_addr)
-        return;
-    
-    // bounds check
-    if ((uintptr_t)frame_physical_addr == 0)
-        return;
-    
-    // frame must be within valid physical memory range
-    uint32_t max_phys_addr = kmm_get_total_frames() * VMM_PAGE_SIZE;
+    if (frame_phys / VMM_PAGE_SIZE >= _KMM_PTR_FRAMES)
+        return false;
 
-    if ((uintptr_t)frame_physical_addr >= max_phys_addr)
-        return;
+    void* frame = (void*)(uintptr_t)frame_phys;
+    frame_desc_t* desc = kmm_frame_desc(frame);
 
+    if (!desc || desc->refcount < 2)
+        return false;
 
-    // free in physical memory
-    kmm_frame_free(frame_physical_addr);
+    if (desc->mapcount > 0)
+        desc->mapcount -= 1;
 
-    // mark as not present
-    *pte = (uint32_t)PTE_FRAME_ADDR(*pte) & (uint32_t)~PTE_PRESENT;
+    kmm_frame_put(frame);
 
+    return true;
 }
 
-bool vmm_alloc_region(pagedir_t* pdir, void* virtual, size_t size, uint32_t flags)
+// backs 'count' empty PTEs with zeroed frames taken from kmm in one batch
+// (the zero pool's first). on failure nothing is mapped and the frames go back
+static bool _vmm_fill_ptes(pte_t** ptes, uint32_t count, uint32_t flags)
 {
-    // validate parameters
-    if (!pdir || !virtual)
+    void* frames[VMM_BATCH_FRAMES];
+    uint32_t taken = kmm_frame_alloc_batch_zeroed(frames, count);
+
+    if (taken < count)
     {
-        // LOG_ERROR("vmm_alloc_region: Param(s) are NULL!\n");
+        kmm_frame_free_batch(frames, taken);
         return false;
     }
 
-    if (size == 0)
+    for (uint32_t i = 0; i < count; i++)
     {
-        // LOG_ERROR("vmm_alloc_region: Size of region is zero!\n");
-        return false;
+        _vmm_track_frame(frames[i], flags);
+
+        _vmm_set_pte(ptes[i], _pte_create(frames[i], flags));
     }
 
-    // compute starting and ending addresses
-    // uintptr_t start_addr = (uintptr_t) ALIGN((uintptr_t)virtual, VMM_PAGE_SIZE);
+    return true;
+}
 
-    // this janky thing passes tests
-    uintptr_t start_addr = ((uintptr_t)virtual) & ~(VMM_PAGE_SIZE - 1);
+// frees the page tables of PDEs 'first' to 'last' that have no entry in
+// use. returns true when one was freed
+static bool _vmm_free_empty_tables(pagedir_t* pdir, uint32_t first, uint32_t last)
+{
+    bool freed_any_pt = false;
+
+    for (uint32_t pd_index = first; pd_index <= last; pd_index++)
+    {
+        // kernel page tables are shared by every address space
+        if (_vmm_kernel_template_ready && pd_index >= VMM_KERNEL_PDE_FIRST)
+            break;
+
+        pde_t pde = pdir->table[pd_index];
+
+        // skip if page table doesn't exist (or is a large page)
+        if (!PDE_IS_PRESENT(pde) || PDE_IS_4MB(pde))
+            continue;
+
+        // get the page table
+        uint32_t pagetable_phys_addr = PDE_PTABLE_ADDR(pde);
+        pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT(pagetable_phys_addr);
+
+        // if no entry is in use (reserved pages count), free the page table
+        if (_vmm_pt_used(ptable) == 0)
+        {
+            // free page table frame
+            kmm_frame_free((void*)pagetable_phys_addr);
+
+            // clear the page directory entry
+            pdir->table[pd_index] = 0;
+            freed_any_pt = true;
+
+#ifdef VMM_RECURSIVE
+            // the recursive mapping may still cache the table
+            if (_vmm_recursive_current(pdir))
+                flush_tlb(VMM_RECURSIVE_PTE(pd_index * VMM_LARGE_PAGE_SIZE));
+#endif
+        }
+    }
+
+    return freed_any_pt;
+}
+
+// returns the PDE covering 'virtual'. with PAE this walks the PDPT first,
+// which points at the directories right after it in the pagedir_t
+static inline pde_t* _vmm_get_pde(pagedir_t* pdir, uintptr_t virtual)
+{
+#ifdef VMM_PAE
+    pdpte_t pdpte = pdir->pdpt[VMM_PDPT_INDEX(virtual)];
+
+    if (!PDPTE_IS_PRESENT(pdpte))
+        return NULL;
+
+    pde_t* dir = (pde_t*) PHYS_TO_VIRT((uintptr_t)PDPTE_DIR_ADDR(pdpte));
+
+    return &dir[VMM_PD_INDEX(virtual)];
+#else
+    return &pdir->table[VMM_DIR_INDEX(virtual)];
+#endif
+}
+
+// turns on CR4.PSE when the CPU has it (CPUID.1:EDX bit 3). PAE paging
+// takes large PDEs without it, the bit is set anyway so both modes agree
+static bool _vmm_enable_pse(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+
+    if (!(edx & (1u << 3)))
+        return false;
+
+    uint32_t cr4_value;
+
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4_value));
+    asm volatile ("mov %0, %%cr4" :: "r"(cr4_value | 0x10));
+
+    return true;
+}
+
+// turns on CR4.PGE when the CPU has it (CPUID.1:EDX bit 13)
+static bool _vmm_enable_pge(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+
+    if (!(edx & (1u << 13)))
+        return false;
+
+    uint32_t cr4_value;
+
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4_value));
+    asm volatile ("mov %0, %%cr4" :: "r"(cr4_value | 0x80));
+
+    return true;
+}
+
+#ifdef VMM_PAE
+// switches from the 32-bit boot tables to the PAE address space whose PDPT
+// is at 'pdpt_phys'. paging is off for a few instructions, so this runs from
+// a copy of mm/pae.s in identity mapped low memory with interrupts off
+static void _vmm_enable_pae(uint32_t pdpt_phys)
+{
+    uint32_t size = (uint32_t)(vmm_pae_trampoline_end - vmm_pae_trampoline);
+    void (*trampoline)(uint32_t) = (void (*)(uint32_t)) PAE_TRAMPOLINE_PHYS;
+
+    // low memory is identity mapped by the boot tables and the new ones
+    memcpy((void*)PAE_TRAMPOLINE_PHYS, vmm_pae_trampoline, size);
+
+    uint32_t eflags;
+    asm volatile ("pushf; pop %0; cli" : "=r"(eflags) :: "memory");
+
+    trampoline(pdpt_phys);
+
+    // restore the interrupt flag
+    if (eflags & 0x200)
+        asm volatile ("sti" ::: "memory");
+
+    _vmm_pae_active = true;
+}
+#endif
+
+void vmm_init(void)
+{
+    LOG_DEBUG("------------------------------\n");
+    LOG_DEBUG("VMM INIT\n");
+
+    // a second init builds the kernel half from scratch
+    _vmm_kernel_template_ready = false;
+
+#ifdef VMM_RECURSIVE
+    _vmm_recursive_loaded = false;
+#endif
+
+    // nothing cached before survives
+    _vmm_xlate_epoch++;
+
+    vma_init();
+
+    // built-in fault resolvers, then the page fault interrupt handler
+    _vmm_fault_resolver_count = 0;
+
+    vmm_register_fault_resolver("lazy", _vmm_resolve_lazy);
+    vmm_register_fault_resolver("cow", _vmm_resolve_cow);
+    vmm_register_fault_resolver("guard", _vmm_resolve_guard);
+    vmm_register_fault_resolver("swap", _vmm_resolve_swap);
+
+    // frames run low: cold pages go to swap, when there is a swap area
+    vmm_set_reclaim_watermark(VMM_RECLAIM_WATERMARK);
+
+    register_interrupt_handler(PAGE_FAULT_INTERRUPT, _vmm_page_fault_handler);
+
+    // large pages have to be enabled before a directory using them is loaded
+    _vmm_large_pages = _vmm_enable_pse();
+
+    // everything mapped from here on in the kernel half is global
+    _vmm_global_pages = _vmm_enable_pge();
+
+    // supervisor writes must fault on read-only pages too, copy-on-write
+    // relies on it (CR0.WP)
+    uint32_t cr0_value;
+
+    asm volatile ("mov %%cr0, %0" : "=r"(cr0_value));
+    asm volatile ("mov %0, %%cr0" :: "r"(cr0_value | 0x10000));
+
+    // create new address space for the kernel
+    pagedir_t* kernel_addr_space = vmm_create_address_space();
+
+    // sanity check
+    if (!kernel_addr_space)
+        return;
+
+    // set kernel_pagedir
+    LOG_DEBUG("Set kernel page directory: 0x%08x\n", (uint32_t)kernel_addr_space);
+    _vmm_kernel_pagedir = kernel_addr_space; 
+
+    uint64_t map_start = rdtsc();
+
+    // set up identity mapping for first 1MB of physical memory (virtual address equal to physical address)
+    LOG_DEBUG("Setting up identity mapping...\n");
+    vmm_map_range(kernel_addr_space, (void*)IDENTITY_MAP_START, IDENTITY_MAP_START,
+                  IDENTITY_MAP_END - IDENTITY_MAP_START, PTE_PRESENT | PTE_WRITABLE);
+
+    // set up physmap (map all available physical memory starting at PHYSMAP_BASE (3GB))
+    uint32_t total_frames = kmm_get_total_frames();
+    uint32_t max_phys_addr = total_frames * VMM_PAGE_SIZE;
+
+    // memory above PHYSMAP_MAX_SIZE (the HIGH zone) is not mapped, the
+    // virtual space past it belongs to the kernel heap
+    if (total_frames > PHYSMAP_MAX_SIZE / VMM_PAGE_SIZE)
+        max_phys_addr = PHYSMAP_MAX_SIZE;
+
+    // whole large pages need no page table (this covers the kernel image
+    // too), the tail or everything without PSE goes page by page
+    LOG_DEBUG("Setting up physmap...\n");
+    vmm_map_range(kernel_addr_space, PHYS_TO_VIRT(0), 0, max_phys_addr, PTE_PRESENT | PTE_WRITABLE);
+
+    _vmm_boot_map_cycles = rdtsc() - map_start;
+    LOG_DEBUG("Boot mapping cycles: %llu\n", _vmm_boot_map_cycles);
+
+    // every kernel PDE past the physmap gets its page table now, so kernel
+    // mappings made later land in tables that all address spaces share. the
+    // physmap past the end of memory stays unmapped for good
+    LOG_DEBUG("Preallocating kernel page tables...\n");
+    for (uint32_t i = VMM_DIR_INDEX(PHYSMAP_BASE + PHYSMAP_MAX_SIZE); i < VMM_KERNEL_PDE_END; i++)
+        vmm_create_pt(kernel_addr_space, (void*)(i * VMM_LARGE_PAGE_SIZE), PDE_PRESENT | PDE_WRITABLE);
+
+    _vmm_kernel_template_ready = true;
+
+    // THIS DOES NOT PRINT OUT!
+    // switch to the newly created kernel page directory
+    LOG_DEBUG("Switching to kernel space...\n");
+    vmm_switch_pagedir(kernel_addr_space);
+
+    // the frame read faults of lazy pages share, until the first write
+    _vmm_zero_frame = kmm_frame_alloc_zeroed();
+
+    if (_vmm_zero_frame)
+        kmm_frame_set_flags(_vmm_zero_frame, KMM_FRAME_KERNEL);
+
+#ifdef SWAP_BOOT_SLOTS
+    // RAM swap area asked for at build time
+    swap_init(SWAP_BOOT_SLOTS);
+#endif
+
+    kmm_print_status();
+
+}
+
+pagedir_t* vmm_create_address_space(void)
+{
+#ifdef VMM_PAE
+    // the PDPT page and the four directories are allocated as one run
+    uint32_t frames = sizeof(pagedir_t) / VMM_PAGE_SIZE;
+    void* frame_phys_addr = kmm_frames_alloc(frames, 1);
+
+    if (!frame_phys_addr)
+        return NULL;
+
+    pagedir_t* pagedir_addr = PHYS_TO_VIRT(frame_phys_addr);
+
+    memset(pagedir_addr, 0, sizeof(pagedir_t));
+
+    for (uint32_t i = 0; i < frames; i++)
+        kmm_frame_set_flags((uint8_t*)frame_phys_addr + i * VMM_PAGE_SIZE, KMM_FRAME_PAGETABLE);
+
+    // every directory is present from the start, CR3 loads all four PDPTEs
+    for (uint32_t i = 0; i < VMM_PDPT_ENTRIES; i++)
+    {
+        uintptr_t dir_phys = (uintptr_t)VIRT_TO_PHYS(&pagedir_addr->table[i * VMM_PAGES_PER_TABLE]);
+
+        pagedir_addr->pdpt[i] = (pdpte_t)dir_phys | PDPTE_PRESENT;
+    }
+
+    _vmm_copy_kernel_pdes(pagedir_addr);
+    _vmm_forget_fault_stats(pagedir_addr);
+    _vmm_forget_xlate_cache(pagedir_addr);
+    vma_space_destroy(pagedir_addr);
+
+    return pagedir_addr;
+#else
+    // allocate a zeroed physical frame (clears out the page directory)
+    void* frame_phys_addr = kmm_frame_alloc_zeroed();
+
+    if (!frame_phys_addr)
+        return NULL;
+
+    kmm_frame_set_flags(frame_phys_addr, KMM_FRAME_PAGETABLE);
+
+    // for page tables and dirs to access this frame, need to convert it into virtual address
+    pagedir_t* pagedir_addr = PHYS_TO_VIRT(frame_phys_addr);
+
+    _vmm_copy_kernel_pdes(pagedir_addr);
+    _vmm_forget_fault_stats(pagedir_addr);
+    _vmm_forget_xlate_cache(pagedir_addr);
+    vma_space_destroy(pagedir_addr);
+
+    return pagedir_addr;
+#endif
+}
+
+void vmm_map_page(pagedir_t* pdir, void* virtual, void* physical, uint32_t flags)
+{
+    vmm_map_page_phys(pdir, virtual, (phys_addr_t)(uintptr_t)physical, flags);
+}
+
+void vmm_map_page_phys(pagedir_t* pdir, void* virtual, phys_addr_t physical, uint32_t flags)
+{
+    // TODO: validate if pdir exists
+    if (!pdir)
+    {
+        LOG_ERROR("Page directory is NULL!\n");
+        return;
+    }
+
+#ifdef VMM_RECURSIVE
+    // a PTE up there would be a PDE of the directory itself
+    if ((uintptr_t)virtual >= VMM_RECURSIVE_BASE)
+    {
+        LOG_ERROR("ERROR: virt 0x%08x is inside the recursive mapping\n", (uint32_t)virtual);
+        return;
+    }
+#endif
+
+    // ensure a page table exists for the virtual address
+    // done by walking down to the PDE
+    pde_t* pde_entry = _vmm_get_pde(pdir, (uintptr_t)virtual);
+
+    if (!pde_entry)
+        return;
+
+    pde_t pde = *pde_entry;
+
+    // Create page table if needed
+    if (!PDE_IS_PRESENT(pde))
+    {
+        vmm_create_pt(pdir, virtual, PDE_PRESENT | PDE_WRITABLE);
+        
+        // re-read PDE after creation
+        pde = *pde_entry;
+        
+        if (!PDE_IS_PRESENT(pde))
+        {
+            LOG_ERROR("ERROR: Failed to create page table for virt 0x%08x\n", (uint32_t)virtual);
+            return;
+        }
+    }
+
+    // a large page has no page table to put the entry in
+    if (PDE_IS_4MB(pde))
+    {
+        LOG_ERROR("ERROR: virt 0x%08x is inside a large page\n", (uint32_t)virtual);
+        return;
+    }
+
+    // locate appropriate entry within the page table
+    pte_t* pte = _vmm_find_pte(pdir, (uintptr_t)virtual);
+
+    // create mapping
+    pte_t new_pte = _pte_create_phys(physical, _vmm_page_flags((uintptr_t)virtual, flags));
+
+    // a global entry survives CR3 loads, replacing one needs an invlpg
+    bool was_present = PTE_IS_PRESENT(*pte);
+
+    _vmm_swap_drop(*pte);
+
+    // assign to entry
+    _vmm_set_pte(pte, new_pte);
+
+    // only present entries are cached or in the TLB
+    if (was_present)
+    {
+        flush_tlb(virtual);
+        _vmm_xlate_forget(pdir, (uintptr_t)virtual, 1);
+    }
+}
+
+bool vmm_map_large_page(pagedir_t* pdir, void* virtual, phys_addr_t physical, uint32_t flags)
+{
+    if (!pdir)
+        return false;
+
+    // both addresses must sit on a large page boundary
+    if (((uintptr_t)virtual % VMM_LARGE_PAGE_SIZE) != 0 || (physical % VMM_LARGE_PAGE_SIZE) != 0)
+        return false;
+
+    // kernel PDEs are shared by copy, they can't change after vmm_init
+    if (_vmm_kernel_template_ready && (uintptr_t)virtual >= VMM_KERNEL_BASE)
+        return false;
+
+    pde_t* pde_entry = _vmm_get_pde(pdir, (uintptr_t)virtual);
+
+    // never drop a page table that is already there
+    if (!pde_entry || (PDE_IS_PRESENT(*pde_entry) && !PDE_IS_4MB(*pde_entry)))
+        return false;
+
+    // PDE_GLOBAL is the same bit as PTE_GLOBAL in a large PDE
+    flags = _vmm_page_flags((uintptr_t)virtual, flags);
+
+    *pde_entry = (physical & PDE_LARGE_FRAME_MASK) | (flags & ~PDE_FRAME_MASK) | PDE_SIZE_4MB;
+
+    flush_tlb(virtual);
+    _vmm_xlate_forget(pdir, (uintptr_t)virtual, VMM_PAGES_PER_TABLE);
+
+    return true;
+}
+
+bool vmm_map_range(pagedir_t* pdir, void* virtual, phys_addr_t physical, size_t size, uint32_t flags)
+{
+    if (!pdir || size == 0)
+        return false;
+
+    uintptr_t virt = (uintptr_t)virtual & ~(uintptr_t)(VMM_PAGE_SIZE - 1);
+    uintptr_t end = (uintptr_t) ALIGN((uintptr_t)virtual + size, VMM_PAGE_SIZE);
+
+    // counted in pages, a range up to the top of memory ends at 0
+    uint32_t pages = (end - virt) / VMM_PAGE_SIZE;
+
+    physical &= ~(phys_addr_t)(VMM_PAGE_SIZE - 1);
+
+#ifdef VMM_RECURSIVE
+    // the recursive mapping holds the tables themselves
+    if (virt + pages * VMM_PAGE_SIZE - 1 >= VMM_RECURSIVE_BASE)
+        return false;
+#endif
+
+    _vmm_xlate_forget(pdir, virt, pages);
+
+    // entries that were present already need an invalidation
+    vmm_tlb_batch_t tlb;
+    vmm_tlb_batch_init(&tlb, pdir);
+
+    bool ok = true;
+
+    while (pages > 0)
+    {
+        pde_t* pde_entry = _vmm_get_pde(pdir, virt);
+
+        if (!pde_entry)
+        {
+            ok = false;
+            break;
+        }
+
+        // a whole large page where both addresses allow it and no page
+        // table is in the way (kernel PDEs are fixed after vmm_init)
+        if (_vmm_large_pages && pages >= VMM_PAGES_PER_TABLE &&
+            !(virt & (VMM_LARGE_PAGE_SIZE - 1)) && !(physical & (VMM_LARGE_PAGE_SIZE - 1)) &&
+            (!PDE_IS_PRESENT(*pde_entry) || PDE_IS_4MB(*pde_entry)) &&
+            !(_vmm_kernel_template_ready && virt >= VMM_KERNEL_BASE))
+        {
+            if (!vmm_map_large_page(pdir, (void*)virt, physical, flags))
+            {
+                ok = false;
+                break;
+            }
+
+            virt += VMM_LARGE_PAGE_SIZE;
+            physical += VMM_LARGE_PAGE_SIZE;
+            pages -= VMM_PAGES_PER_TABLE;
+            continue;
+        }
+
+        if (!PDE_IS_PRESENT(*pde_entry))
+            vmm_create_pt(pdir, (void*)virt, PDE_PRESENT | PDE_WRITABLE);
+
+        if (!PDE_IS_PRESENT(*pde_entry) || PDE_IS_4MB(*pde_entry))
+        {
+            LOG_ERROR("vmm_map_range: no page table for virt 0x%08x\n", (uint32_t)virt);
+            ok = false;
+            break;
+        }
+
+        // the rest of this table in one go
+        pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT((uintptr_t)PDE_PTABLE_ADDR(*pde_entry));
+        uint32_t first = VMM_TABLE_INDEX(virt);
+        uint32_t count = VMM_PAGES_PER_TABLE - first;
+
+        if (count > pages)
+            count = pages;
+
+        // a range may cross into the kernel half, a table never does
+        uint32_t page_flags = _vmm_page_flags(virt, flags);
+        bool in_use = _vmm_pte_in_use(page_flags);
+        int32_t delta = 0;
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            pte_t* pte = &ptable->table[first + i];
+
+            if (PTE_IS_PRESENT(*pte))
+                vmm_tlb_batch_add(&tlb, (void*)(virt + i * VMM_PAGE_SIZE));
+
+            delta += (int32_t)in_use - (int32_t)_vmm_pte_in_use(*pte);
+            *pte = _pte_create_phys(physical + i * VMM_PAGE_SIZE, page_flags);
+        }
+
+        _vmm_count_ptes(&ptable->table[first], delta);
+
+        virt += count * VMM_PAGE_SIZE;
+        physical += count * VMM_PAGE_SIZE;
+        pages -= count;
+    }
+
+    vmm_tlb_batch_flush(&tlb);
+
+    return ok;
+}
+
+// drops the mappings of a range, the frames behind them stay with the caller
+bool vmm_unmap_range(pagedir_t* pdir, void* virtual, size_t size)
+{
+    if (!pdir || size == 0)
+        return false;
+
+    uintptr_t virt = (uintptr_t)virtual & ~(uintptr_t)(VMM_PAGE_SIZE - 1);
+    uintptr_t end = (uintptr_t) ALIGN((uintptr_t)virtual + size, VMM_PAGE_SIZE);
+    uint32_t pages = (end - virt) / VMM_PAGE_SIZE;
+
+    uint32_t first_pd = VMM_DIR_INDEX(virt);
+    uint32_t last_pd = VMM_DIR_INDEX(virt + pages * VMM_PAGE_SIZE - 1);
+
+    _vmm_xlate_forget(pdir, virt, pages);
+
+    vmm_tlb_batch_t tlb;
+    vmm_tlb_batch_init(&tlb, pdir);
+
+    while (pages > 0)
+    {
+        pde_t* pde_entry = _vmm_get_pde(pdir, virt);
+
+        // pages left in the table (or large page) 'virt' is in
+        uint32_t count = VMM_PAGES_PER_TABLE - VMM_TABLE_INDEX(virt);
+
+        if (count > pages)
+            count = pages;
+
+        if (!pde_entry || !PDE_IS_PRESENT(*pde_entry))
+        {
+            // nothing mapped here
+        }
+        else if (PDE_IS_4MB(*pde_entry))
+        {
+            // large pages only go when the range covers them whole
+            if (count == VMM_PAGES_PER_TABLE && !(_vmm_kernel_template_ready && virt >= VMM_KERNEL_BASE))
+            {
+                *pde_entry = 0;
+                vmm_tlb_batch_add(&tlb, (void*)virt);
+            }
+        }
+        else
+        {
+            pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT((uintptr_t)PDE_PTABLE_ADDR(*pde_entry));
+            uint32_t first = VMM_TABLE_INDEX(virt);
+            int32_t delta = 0;
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                pte_t* pte = &ptable->table[first + i];
+
+                if (PTE_IS_PRESENT(*pte))
+                    vmm_tlb_batch_add(&tlb, (void*)(virt + i * VMM_PAGE_SIZE));
+
+                _vmm_swap_drop(*pte);
+                delta -= (int32_t)_vmm_pte_in_use(*pte);
+                *pte = 0;
+            }
+
+            _vmm_count_ptes(&ptable->table[first], delta);
+        }
+
+        virt += count * VMM_PAGE_SIZE;
+        pages -= count;
+    }
+
+    vmm_tlb_batch_flush(&tlb);
+
+    // page tables left empty go back to kmm
+    _vmm_free_empty_tables(pdir, first_pd, last_pd);
+
+    return true;
+}
+
+void vmm_create_pt(pagedir_t* pdir, void* virtual, uint32_t flags)
+{
+    // LOG_DEBUG("Inside create_pt!\n");
+    // LOG_DEBUG("Inside create_pt!\n");
+    // LOG_DEBUG("Inside create_pt!\n");
+    // LOG_DEBUG("Inside create_pt!\n");
+
+    if (!pdir)
+    {
+        // LOG_ERROR("PDIR DOES NOT EXIST!\n");
+        return;
+    }
+
+    // determine which dir entry corresponding to virtual address
+    pde_t* pde = _vmm_get_pde(pdir, (uintptr_t)virtual);
+
+    // check if page table already exists
+    if (!pde || PDE_IS_PRESENT(*pde))
+        return;
+
+    // a new kernel PDE would only reach this one address space
+    if (_vmm_kernel_template_ready && (uintptr_t)virtual >= VMM_KERNEL_BASE)
+    {
+        LOG_ERROR("vmm_create_pt: kernel page tables are fixed after init (virt 0x%08x)\n", (uint32_t)virtual);
+        return;
+    }
+    
+    // table does not exist
+    // allocate and init new page table (already cleared)
+    // LOG_DEBUG("Calling kmm_frame_alloc\n");
+    void* table_frame_addr = kmm_frame_alloc_zeroed();
+    // LOG_DEBUG("Outside kmm_frame_alloc\n");
+
+    if (!table_frame_addr)
+        return;
+
+    kmm_frame_set_flags(table_frame_addr, KMM_FRAME_PAGETABLE);
+    
+    // update page dir to reference new table
+    pde_t new_entry = _pde_create(table_frame_addr, flags);
+
+    *pde = new_entry;
+}
+
+
+// counters of 'pdir'. when every slot is taken the one picked by the
+// directory's address is reset and taken over
+static vmm_fault_stats_t* _vmm_fault_stats(pagedir_t* pdir)
+{
+    int32_t free_slot = -1;
+
+    for (uint32_t i = 0; i < VMM_FAULT_STAT_SLOTS; i++)
+    {
+        if (_vmm_fault_slots[i].pdir == pdir)
+            return &_vmm_fault_slots[i].stats;
+
+        if (free_slot < 0 && !_vmm_fault_slots[i].pdir)
+            free_slot = (int32_t)i;
+    }
+
+    if (free_slot < 0)
+        free_slot = (int32_t)(((uintptr_t)pdir / VMM_PAGE_SIZE) % VMM_FAULT_STAT_SLOTS);
+
+    _vmm_fault_slots[free_slot].pdir = pdir;
+    memset(&_vmm_fault_slots[free_slot].stats, 0, sizeof(vmm_fault_stats_t));
+
+    return &_vmm_fault_slots[free_slot].stats;
+}
+
+// PTE of 'virtual' in an existing 4KB page table of 'pdir', NULL otherwise
+static pte_t* _vmm_find_pte(pagedir_t* pdir, uintptr_t virtual)
+{
+#ifdef VMM_RECURSIVE
+    // the loaded space: its entries sit at fixed addresses
+    if (_vmm_recursive_current(pdir))
+    {
+        pde_t pde = *VMM_RECURSIVE_PDE(virtual);
+
+        if (!PDE_IS_PRESENT(pde) || PDE_IS_4MB(pde))
+            return NULL;
+
+        return VMM_RECURSIVE_PTE(virtual);
+    }
+#endif
+
+    pde_t* pde_entry = _vmm_get_pde(pdir, virtual);
+
+    if (!pde_entry || !PDE_IS_PRESENT(*pde_entry) || PDE_IS_4MB(*pde_entry))
+        return NULL;
+
+    pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT((uintptr_t)PDE_PTABLE_ADDR(*pde_entry));
+
+    return &(ptable->table[VMM_TABLE_INDEX(virtual)]);
+}
+
+// whether the access in 'error_code' is allowed by the flags saved in a
+// not-present 'pte' (or one a fault is about to make writable): user
+// accesses need PTE_USER, writes need PTE_WRITABLE or PTE_COW. resolvers
+// check it before allocating, a refused access stays an unresolved fault
+static inline bool _vmm_access_allowed(pte_t pte, uint32_t error_code)
+{
+    if ((error_code & VMM_PF_USER) && !(pte & PTE_USER))
+        return false;
+
+    if ((error_code & VMM_PF_WRITE) && !(pte & (PTE_WRITABLE | PTE_COW)))
+        return false;
+
+    return true;
+}
+
+// backs a not-present page carrying 'marker' with a zeroed frame, the
+// other flags of the entry are the ones it is mapped with
+static bool _vmm_back_marked_page(pte_t* pte, pte_t marker, uintptr_t virtual)
+{
+    uint32_t flags = (uint32_t)(PTE_FLAGS(*pte) & ~marker) | PTE_PRESENT;
+    void* frame = kmm_frame_alloc_zeroed();
+
+    if (!frame)
+    {
+        LOG_ERROR("vmm: out of memory backing page 0x%08x\n", (uint32_t)virtual);
+        return false;
+    }
+
+    _vmm_track_frame(frame, flags);
+
+    // not present before, so nothing stale in the TLB
+    _vmm_set_pte(pte, _pte_create(frame, flags));
+
+    return true;
+}
+
+// resolver: first touch of a reserved (PTE_LAZY) page
+static bool _vmm_resolve_lazy(pagedir_t* pdir, uintptr_t virtual, uint32_t error_code)
+{
+    if (error_code & VMM_PF_PRESENT)
+        return false;
+
+    pte_t* pte = _vmm_find_pte(pdir, virtual);
+
+    // a page of a lazy VMA whose table is gone (unmapped, or never built) is
+    // reserved again from the VMA. a page freed on its own stays freed, a
+    // touch after vmm_page_free is a use after free
+    if (!pte && virtual < VMM_KERNEL_BASE)
+    {
+        vma_t* vma = vma_find(vma_space_get(pdir, false), virtual);
+
+        if (!vma || vma->backing != VMA_BACKING_LAZY ||
+            !_vmm_access_allowed(_vmm_page_flags(virtual, vma->flags), error_code))
+            return false;
+
+        vmm_create_pt(pdir, (void*)virtual, PDE_PRESENT | PDE_WRITABLE);
+        pte = _vmm_find_pte(pdir, virtual);
+
+        if (!pte)
+            return false;
+
+        _vmm_set_pte(pte, (_vmm_page_flags(virtual, vma->flags) & ~PTE_PRESENT) | PTE_LAZY);
+    }
+
+    if (!pte || PTE_IS_PRESENT(*pte) || !(*pte & PTE_LAZY) || !_vmm_access_allowed(*pte, error_code))
+        return false;
+
+    // a read maps the zero frame, copy-on-write if the page is writable, so
+    // pages that are only read never take a frame of their own
+    if (!(error_code & VMM_PF_WRITE) && _vmm_zero_frame)
+    {
+        uint32_t flags = (uint32_t)(PTE_FLAGS(*pte) & ~PTE_LAZY) | PTE_PRESENT;
+
+        if (flags & PTE_WRITABLE)
+            flags = (flags & ~PTE_WRITABLE) | PTE_COW;
+
+        // not present before, so nothing stale in the TLB
+        _vmm_set_pte(pte, _pte_create(_vmm_zero_frame, flags));
+
+        _vmm_fault_stats(pdir)->zero_page_faults++;
+    }
+    else
+    {
+        if (!_vmm_back_marked_page(pte, PTE_LAZY, virtual))
+            return false;
+
+        _vmm_tag_heap_frame((void*)(uintptr_t)PTE_FRAME_ADDR(*pte), virtual);
+    }
+
+    _vmm_fault_stats(pdir)->lazy_faults++;
+
+    return true;
+}
+
+// resolver: write to a copy-on-write page. the last holder of a frame gets
+// it back writable, everyone else gets a private copy
+static bool _vmm_resolve_cow(pagedir_t* pdir, uintptr_t virtual, uint32_t error_code)
+{
+    if ((error_code & (VMM_PF_PRESENT | VMM_PF_WRITE)) != (VMM_PF_PRESENT | VMM_PF_WRITE))
+        return false;
+
+    pte_t* pte = _vmm_find_pte(pdir, virtual);
+
+    if (!pte || !PTE_IS_PRESENT(*pte) || !(*pte & PTE_COW) || !_vmm_access_allowed(*pte, error_code))
+        return false;
+
+    void* frame = (void*)(uintptr_t)PTE_FRAME_ADDR(*pte);
+    uint32_t flags = (uint32_t)(PTE_FLAGS(*pte) & ~PTE_COW) | PTE_WRITABLE;
+    frame_desc_t* desc = kmm_frame_desc(frame);
+
+    if (frame == _vmm_zero_frame)
+    {
+        // the first write to a page only read so far: a zeroed frame of
+        // its own, nothing to copy
+        frame = kmm_frame_alloc_zeroed();
+
+        if (!frame)
+        {
+            LOG_ERROR("vmm: out of memory backing zero page 0x%08x\n", (uint32_t)virtual);
+            return false;
+        }
+
+        _vmm_track_frame(frame, flags);
+        _vmm_tag_heap_frame(frame, virtual);
+    }
+    else if (desc && desc->refcount > 1)
+    {
+        void* copy = kmm_frame_alloc();
+
+        if (!copy)
+        {
+            LOG_ERROR("vmm: out of memory copying COW page 0x%08x\n", (uint32_t)virtual);
+            return false;
+        }
+
+        kmm_frame_copy(copy, frame);
+        _vmm_track_frame(copy, flags);
+
+        // drop this mapping's reference to the shared frame
+        _vmm_unshare_frame((uintptr_t)frame);
+
+        frame = copy;
+    }
+
+    _vmm_set_pte(pte, _pte_create(frame, flags));
+
+    flush_tlb((void*)virtual);
+    _vmm_xlate_forget(pdir, virtual, 1);
+
+    _vmm_fault_stats(pdir)->cow_faults++;
+
+    return true;
+}
+
+// resolver: touch of a guard page (PTE_GUARD) of a stack VMA. it is backed
+// like a lazy page and the guard moves to the page below, so a downward
+// growing stack keeps one guard under it. the guard at the bottom of the VMA
+// is never backed: touching it is a stack overflow and stays unresolved
+static bool _vmm_resolve_guard(pagedir_t* pdir, uintptr_t virtual, uint32_t error_code)
+{
+    if (error_code & VMM_PF_PRESENT)
+        return false;
+
+    pte_t* pte = _vmm_find_pte(pdir, virtual);
+
+    if (!pte || PTE_IS_PRESENT(*pte) || !(*pte & PTE_GUARD) || !_vmm_access_allowed(*pte, error_code))
+        return false;
+
+    pte_t guard = *pte;
+    uintptr_t page = virtual & ~(uintptr_t)(VMM_PAGE_SIZE - 1);
+    vma_t* vma = (page < VMM_KERNEL_BASE) ? vma_find(vma_space_get(pdir, false), page) : NULL;
+
+    if (!vma || vma->backing != VMA_BACKING_STACK || page <= vma->start)
+    {
+        LOG_ERROR("vmm: stack overflow at 0x%08x\n", (uint32_t)virtual);
+        return false;
+    }
+
+    if (!_vmm_back_marked_page(pte, PTE_GUARD, virtual))
+        return false;
+
+    // the page below may be in a table not built yet
+    uintptr_t below_page = page - VMM_PAGE_SIZE;
+    pte_t* below = _vmm_find_pte(pdir, below_page);
+
+    if (!below)
+    {
+        vmm_create_pt(pdir, (void*)below_page, PDE_PRESENT | PDE_WRITABLE);
+        below = _vmm_find_pte(pdir, below_page);
+    }
+
+    if (below && !(*below & (PTE_PRESENT | VMM_PTE_RESERVED)))
+        _vmm_set_pte(below, guard);
+
+    _vmm_fault_stats(pdir)->guard_faults++;
+
+    return true;
+}
+
+// resolver: touch of a page reclaim sent to swap (PTE_SWAPPED). it comes
+// back in a new frame, with the flags it was mapped with
+static bool _vmm_resolve_swap(pagedir_t* pdir, uintptr_t virtual, uint32_t error_code)
+{
+    if (error_code & VMM_PF_PRESENT)
+        return false;
+
+    pte_t* pte = _vmm_find_pte(pdir, virtual);
+
+    if (!pte || PTE_IS_PRESENT(*pte) || !(*pte & PTE_SWAPPED) || !_vmm_access_allowed(*pte, error_code))
+        return false;
+
+    uint32_t start = (uint32_t)rdtsc();
+
+    // may evict other pages first, never this one
+    void* frame = kmm_frame_alloc();
+
+    if (!frame)
+    {
+        LOG_ERROR("vmm: out of memory swapping in page 0x%08x\n", (uint32_t)virtual);
+        return false;
+    }
+
+    uint32_t slot = _vmm_swap_slot(*pte);
+    uint32_t flags = (uint32_t)(PTE_FLAGS(*pte) & ~PTE_SWAPPED) | PTE_PRESENT;
+
+    swap_read(slot, frame);
+    swap_slot_put(slot);
+
+    _vmm_track_frame(frame, flags);
+
+    // not present before, so nothing stale in the TLB
+    _vmm_set_pte(pte, _pte_create(frame, flags));
+
+    _vmm_fault_stats(pdir)->swap_faults++;
+
+    _vmm_swap_stats.swap_ins++;
+    _vmm_swap_stats.swap_in_cycles += (uint32_t)rdtsc() - start;
+
+    return true;
+}
+
+bool vmm_set_guard_page(pagedir_t* pdir, void* virtual, void* limit, uint32_t flags)
+{
+    if (!pdir)
+        return false;
+
+    uintptr_t addr = (uintptr_t)virtual & ~(uintptr_t)(VMM_PAGE_SIZE - 1);
+    uintptr_t bottom = (uintptr_t)limit & ~(uintptr_t)(VMM_PAGE_SIZE - 1);
+
+    if (bottom > addr)
+        bottom = addr;
+
+    pde_t* pde_entry = _vmm_get_pde(pdir, addr);
+
+    if (!pde_entry)
+        return false;
+
+    if (!PDE_IS_PRESENT(*pde_entry))
+        vmm_create_pt(pdir, (void*)addr, PDE_PRESENT | PDE_WRITABLE);
+
+    pte_t* pte = _vmm_find_pte(pdir, addr);
+
+    // only unused pages become guards
+    if (!pte || (*pte & (PTE_PRESENT | VMM_PTE_RESERVED)))
+        return false;
+
+    // the stack may grow down to 'limit': [limit, guard] is recorded as a
+    // stack VMA, which must not overlap another one. kernel-half guards
+    // have no VMA and never move
+    if (addr < VMM_KERNEL_BASE)
+    {
+        vma_space_t* space = vma_space_get(pdir, true);
+        vma_t* next = vma_next(space, bottom);
+
+        if (!space || (next && next->start <= addr) ||
+            !vma_insert(space, bottom, addr + VMM_PAGE_SIZE, flags, VMA_BACKING_STACK))
+            return false;
+    }
+
+    _vmm_set_pte(pte, (_vmm_page_flags(addr, flags) & ~PTE_PRESENT) | PTE_GUARD);
+
+    return true;
+}
+
+int32_t vmm_register_fault_resolver(const char* name, vmm_fault_resolver_t resolver)
+{
+    if (!name || !resolver || _vmm_fault_resolver_count == VMM_FAULT_RESOLVERS_MAX)
+        return -1;
+
+    _vmm_fault_resolvers[_vmm_fault_resolver_count].name = name;
+    _vmm_fault_resolvers[_vmm_fault_resolver_count].resolver = resolver;
+
+    return (int32_t)_vmm_fault_resolver_count++;
+}
+
+const char* vmm_fault_resolver_name(uint32_t index)
+{
+    return (index < _vmm_fault_resolver_count) ? _vmm_fault_resolvers[index].name : NULL;
+}
+
+const char* vmm_fault_class_name(uint32_t fault_class)
+{
+    static const char* names[VMM_FAULT_CLASSES] =
+    {
+        "kernel read, not present",
+        "kernel read, protection",
+        "kernel write, not present",
+        "kernel write, protection",
+        "user read, not present",
+        "user read, protection",
+        "user write, not present",
+        "user write, protection",
+    };
+
+    return (fault_class < VMM_FAULT_CLASSES) ? names[fault_class] : NULL;
+}
+
+void vmm_get_fault_summary(vmm_fault_summary_t* summary)
+{
+    if (summary)
+        *summary = _vmm_fault_summary;
+}
+
+void vmm_print_fault_stats(void)
+{
+    vmm_fault_summary_t summary = _vmm_fault_summary;
+
+    printf("page faults: %u, unresolved %u\n", summary.faults, summary.unresolved);
+
+    for (uint32_t i = 0; i < VMM_FAULT_CLASSES; i++)
+    {
+        if (summary.class_faults[i])
+            printf("  %s: %u\n", vmm_fault_class_name(i), summary.class_faults[i]);
+    }
+
+    for (uint32_t i = 0; i < _vmm_fault_resolver_count; i++)
+        printf("  resolved by %s: %u\n", _vmm_fault_resolvers[i].name, summary.resolved[i]);
+
+    printf("cycles per fault:\n");
+
+    for (uint32_t i = 0; i < VMM_FAULT_HIST_BUCKETS; i++)
+    {
+        if (summary.cycle_hist[i])
+            printf("  >= %u: %u\n", (i == 0) ? 0 : (1u << (i + VMM_FAULT_HIST_SHIFT)), summary.cycle_hist[i]);
+    }
+}
+
+// histogram bucket of a fault that took 'cycles'
+static inline uint32_t _vmm_fault_hist_bucket(uint32_t cycles)
+{
+    if (cycles < (1u << (VMM_FAULT_HIST_SHIFT + 1)))
+        return 0;
+
+    uint32_t bucket = (31 - (uint32_t)__builtin_clz(cycles)) - VMM_FAULT_HIST_SHIFT;
+
+    return (bucket < VMM_FAULT_HIST_BUCKETS) ? bucket : VMM_FAULT_HIST_BUCKETS - 1;
+}
+
+void _vmm_page_fault_handler(interrupt_context_t* ctx)
+{
+    uint32_t start = (uint32_t)rdtsc();
+
+    uintptr_t fault_addr;
+
+    asm volatile ("mov %%cr2, %0" : "=r"(fault_addr));
+
+    uint32_t fault_class = VMM_FAULT_CLASS(ctx->error_code);
+
+    _vmm_fault_summary.faults++;
+    _vmm_fault_summary.class_faults[fault_class]++;
+
+    pagedir_t* pdir = _vmm_current_pagedir;
+
+    // the first resolver that takes the fault wins
+    for (uint32_t i = 0; pdir && i < _vmm_fault_resolver_count; i++)
+    {
+        if (!_vmm_fault_resolvers[i].resolver(pdir, fault_addr, ctx->error_code))
+            continue;
+
+        _vmm_fault_summary.resolved[i]++;
+        _vmm_fault_summary.cycle_hist[_vmm_fault_hist_bucket((uint32_t)rdtsc() - start)]++;
+
+        return;
+    }
+
+    _vmm_fault_summary.unresolved++;
+
+    if (pdir)
+        _vmm_fault_stats(pdir)->unresolved_faults++;
+
+    // returning would only run into the same fault again
+    LOG_ERROR("PAGE FAULT!!! %s at 0x%08x (eip 0x%08x, error 0x%x)\n",
+              vmm_fault_class_name(fault_class), (uint32_t)fault_addr, ctx->eip, ctx->error_code);
+
+    while (1)
+        asm volatile ("cli; hlt" :::);
+}
+
+
+pagedir_t* vmm_get_kerneldir(void)
+{
+    return _vmm_kernel_pagedir;
+}
+
+pagedir_t* vmm_get_current_pagedir(void)
+{
+    return _vmm_current_pagedir;
+}
+
+void* vmm_get_phys_frame(pagedir_t* pdir, void* virtual)
+{
+    phys_addr_t frame_phys_addr = vmm_get_phys_addr(pdir, virtual);
+
+    // frames above 4GB can't be returned as a pointer
+    if (frame_phys_addr != (uintptr_t)frame_phys_addr)
+        return NULL;
+
+    return (void*)(uintptr_t)frame_phys_addr;
+}
+
+// frame 'virtual' is mapped to in 'pdir', 0 when not mapped
+static phys_addr_t _vmm_walk(pagedir_t* pdir, void* virtual)
+{
+#ifdef VMM_RECURSIVE
+    // the loaded space is two reads at fixed addresses, no walk
+    if (_vmm_recursive_current(pdir))
+    {
+        pde_t pde = *VMM_RECURSIVE_PDE(virtual);
+
+        if (!PDE_IS_PRESENT(pde))
+            return 0;
+
+        if (PDE_IS_4MB(pde))
+            return (phys_addr_t) PDE_LARGE_ADDR(pde) + ((uintptr_t)virtual & (VMM_LARGE_PAGE_SIZE - VMM_PAGE_SIZE));
+
+        pte_t pte = *VMM_RECURSIVE_PTE(virtual);
+
+        return PTE_IS_PRESENT(pte) ? (phys_addr_t) PTE_FRAME_ADDR(pte) : 0;
+    }
+#endif
+
+    // get page dir entry (walks the PDPT with PAE)
+    pde_t* pde_entry = _vmm_get_pde(pdir, (uintptr_t)virtual);
+
+    // check if ptable exists
+    if (!pde_entry || !PDE_IS_PRESENT(*pde_entry))
+        return 0;
+
+    pde_t pde = *pde_entry;
+
+    // large page: the frame is an offset into it
+    if (PDE_IS_4MB(pde))
+        return (phys_addr_t) PDE_LARGE_ADDR(pde) + ((uintptr_t)virtual & (VMM_LARGE_PAGE_SIZE - VMM_PAGE_SIZE));
+
+
+    // get page table
+    uint32_t pagetable_phys_addr = (uint32_t) PDE_PTABLE_ADDR(pde);
+
+    pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT(pagetable_phys_addr);
+
+    // find page table entry
+    uint32_t pagetable_i = VMM_TABLE_INDEX(virtual);
+
+    pte_t pte = ptable->table[pagetable_i];
+
+    // check if entry is present
+    if (!PTE_IS_PRESENT(pte))
+        return 0;
+
+
+    // get physical frame address
+    return (phys_addr_t) PTE_FRAME_ADDR(pte);
+}
+
+phys_addr_t vmm_get_phys_addr(pagedir_t* pdir, void* virtual)
+{
+    // validate addresses
+    if (!pdir || !virtual) 
+        return 0;
+
+    uint32_t vpn = (uintptr_t)virtual / VMM_PAGE_SIZE;
+    vmm_xlate_cache_t* cache = _vmm_xlate_cache(pdir, true);
+
+    _vmm_xlate_stats.lookups++;
+
+    if (cache->entries[vpn % VMM_XLATE_ENTRIES].tag == vpn + 1)
+    {
+        _vmm_xlate_stats.hits++;
+        return cache->entries[vpn % VMM_XLATE_ENTRIES].frame;
+    }
+
+    phys_addr_t frame = _vmm_walk(pdir, virtual);
+
+    // only mappings are cached, a page that is not mapped yet may be soon
+    if (frame)
+    {
+        cache->entries[vpn % VMM_XLATE_ENTRIES].tag = vpn + 1;
+        cache->entries[vpn % VMM_XLATE_ENTRIES].frame = frame;
+    }
+
+    return frame;
+}
+
+// splits the buffer [virtual, virtual + size) into physically contiguous
+// extents, walking each page table once. returns the number of extents, 0
+// when a page of the buffer is not mapped or 'max_extents' is too few
+uint32_t vmm_translate_range(pagedir_t* pdir, void* virtual, size_t size, vmm_extent_t* extents, uint32_t max_extents)
+{
+    if (!pdir || !extents || max_extents == 0 || size == 0)
+        return 0;
+
+    uintptr_t addr = (uintptr_t)virtual;
+    uint32_t count = 0;
+
+    while (size > 0)
+    {
+        pde_t* pde_entry = _vmm_get_pde(pdir, addr);
+
+        if (!pde_entry || !PDE_IS_PRESENT(*pde_entry))
+            return 0;
+
+        // bytes of the buffer in this table (or large page)
+        uintptr_t covered = VMM_LARGE_PAGE_SIZE - (addr & (VMM_LARGE_PAGE_SIZE - 1));
+
+        if (covered > size)
+            covered = size;
+
+        pde_t pde = *pde_entry;
+        pagetable_t* ptable = PDE_IS_4MB(pde) ? NULL : (pagetable_t*) PHYS_TO_VIRT((uintptr_t)PDE_PTABLE_ADDR(pde));
+
+        phys_addr_t phys;
+        uint32_t chunk;
+
+        for (uintptr_t done = 0; done < covered; done += chunk, addr += chunk)
+        {
+            if (!ptable)
+            {
+                // the rest of the large page is one piece
+                phys = (phys_addr_t) PDE_LARGE_ADDR(pde) + (addr & (VMM_LARGE_PAGE_SIZE - 1));
+                chunk = covered - done;
+            }
+            else
+            {
+                pte_t pte = ptable->table[VMM_TABLE_INDEX(addr)];
+
+                if (!PTE_IS_PRESENT(pte))
+                    return 0;
+
+                phys = (phys_addr_t) PTE_FRAME_ADDR(pte) + VMM_PAGE_OFFSET(addr);
+                chunk = VMM_PAGE_SIZE - VMM_PAGE_OFFSET(addr);
+
+                if (chunk > covered - done)
+                    chunk = covered - done;
+            }
+
+            // grow the last extent when this piece follows it
+            if (count > 0 && extents[count - 1].phys + extents[count - 1].size == phys)
+            {
+                extents[count - 1].size += chunk;
+                continue;
+            }
+
+            if (count == max_extents)
+                return 0;
+
+            extents[count].phys = phys;
+            extents[count].size = chunk;
+            count++;
+        }
+
+        size -= covered;
+    }
+
+    return count;
+}
+
+void vmm_get_xlate_stats(vmm_xlate_stats_t* stats)
+{
+    if (stats)
+        *stats = _vmm_xlate_stats;
+}
+
+int32_t vmm_page_alloc(pte_t* pte, uint32_t flags)
+{
+    // validate PTE pointer
+    // if PTE is present, return 0
+    if (!pte)
+    {
+        // LOG_ERROR("vmm_page_alloc: PTE is NULL!\n");
+        return -1;
+    }
+    
+    // check if the entry already has an allocated frame
+    if (PTE_IS_PRESENT(*pte))
+    {
+        // LOG_ERROR("vmm_page_alloc: PTE already present!\n");
+        return 0;
+    }
+
+    // user pages are never global
+    if (flags & PTE_USER)
+        flags &= ~PTE_GLOBAL;
+
+    // allocate a new physical frame and create a PTE to reference it
+    void* frame_physical_addr = kmm_frame_alloc();
+
+    // check if OOM
+    if (!frame_physical_addr)
+    {
+        // LOG_ERROR("vmm_page_alloc: Out of memory!\n");
+        return -1;
+    }
+
+    _vmm_track_frame(frame_physical_addr, flags);
+
+    // create PTE for the frame
+    pte_t new_entry = _pte_create(frame_physical_addr, flags);
+
+    _vmm_set_pte(pte, new_entry);
+
+    return 0;
+
+}
+
+void vmm_page_free(pte_t* pte)
+{
+    // validate PTE
+    if (!pte)
+    {
+        // LOG_ERROR("vmm_page_free: PTE is NULL!\n");
+        return;
+    }
+
+    // check if PTE does not exist (drop a reservation)
+    if (!PTE_IS_PRESENT(*pte))
+    {
+        // LOG_ERROR("vmm_page_free: PTE is not present!");
+        if (*pte & VMM_PTE_RESERVED)
+        {
+            _vmm_swap_drop(*pte);
+            _vmm_set_pte(pte, 0);
+        }
+
+        return;
+    }
+
+    // get physical frame address (may be above 4GB with PAE)
+    phys_addr_t frame_physical_addr = (phys_addr_t)PTE_FRAME_ADDR(*pte);
+
+    if (!frame_physical_addr)
+        return;
+    
+    // frame must be within valid physical memory range
+    if (frame_physical_addr / VMM_PAGE_SIZE >= kmm_get_total_frames())
+        return;
+
+
+    bool global = (*pte & PTE_GLOBAL) != 0;
+
+    // mark as not present
+    _vmm_set_pte(pte, PTE_FRAME_ADDR(*pte));
+
+    // the entry alone does not say which space or page it was: every cached
+    // translation goes, and the whole TLB before kmm can hand the frame out
+    // again (callers that know the address use vmm_free_region instead)
+    _vmm_xlate_epoch++;
+    _vmm_flush_tlb_all(global);
+
+    // free in physical memory (shared frames only lose a reference)
+    if (!_vmm_unshare_frame(frame_physical_addr))
+        kmm_frame_free_phys(frame_physical_addr);
+}
+
+// failure of vmm_alloc_region once its VMA is in: the range is not reserved
+static bool _vmm_alloc_region_failed(pagedir_t* pdir, uintptr_t start, uintptr_t end)
+{
+    if (start < VMM_KERNEL_BASE)
+        vma_remove_range(vma_space_get(pdir, false), start, (end > VMM_KERNEL_BASE) ? VMM_KERNEL_BASE : end);
+
+    return false;
+}
+
+bool vmm_alloc_region(pagedir_t* pdir, void* virtual, size_t size, uint32_t flags)
+{
+    // validate parameters
+    if (!pdir || !virtual)
+    {
+        // LOG_ERROR("vmm_alloc_region: Param(s) are NULL!\n");
+        return false;
+    }
+
+    if (size == 0)
+    {
+        // LOG_ERROR("vmm_alloc_region: Size of region is zero!\n");
+        return false;
+    }
+
+    // compute starting and ending addresses
+    // uintptr_t start_addr = (uintptr_t) ALIGN((uintptr_t)virtual, VMM_PAGE_SIZE);
+
+    // this janky thing passes tests
+    uintptr_t start_addr = ((uintptr_t)virtual) & ~(VMM_PAGE_SIZE - 1);
+
+    uintptr_t end_addr = (uintptr_t) ALIGN((uintptr_t)virtual + size, VMM_PAGE_SIZE);
+
+#ifdef VMM_RECURSIVE
+    // the recursive mapping holds the tables themselves
+    if (end_addr - 1 >= VMM_RECURSIVE_BASE)
+        return false;
+#endif
+
+    // the user half of the range is recorded as a VMA. the kernel half is the
+    // same in every address space (and holds the heap the VMAs live in)
+    if (start_addr < VMM_KERNEL_BASE)
+    {
+        uintptr_t vma_end = (end_addr > VMM_KERNEL_BASE) ? VMM_KERNEL_BASE : end_addr;
+        vma_space_t* space = vma_space_get(pdir, true);
+
+        if (!space || !vma_insert(space, start_addr, vma_end, flags & ~VMM_LAZY,
+                                  (flags & VMM_LAZY) ? VMA_BACKING_LAZY : VMA_BACKING_ANON))
+            return false;
+    }
+
+    // empty PTEs are collected and backed by frames in batches
+    pte_t* batch[VMM_BATCH_FRAMES];
+    uint32_t batch_count = 0;
+    uint32_t batch_flags = flags;
+
+    // iterate through addr
+    for (uintptr_t addr = start_addr; addr < end_addr; addr += VMM_PAGE_SIZE)
+    {
+        // for each addr:
+        // 1) get page table address (create if not found)
+        // 2) queue the PTE for a frame
+        // 3) set the queued PTEs once the batch is full
+
+        // get pagedir entry
+        pde_t* pde_entry = _vmm_get_pde(pdir, addr);
+
+        if (!pde_entry)
+            return _vmm_alloc_region_failed(pdir, start_addr, end_addr);
+
+        // get PDE
+        pde_t pde = *pde_entry;
+
+        // check if a page table is present
+        if (!PDE_IS_PRESENT(pde))
+        {
+            // create a page table
+            vmm_create_pt(pdir, (void*)addr, PDE_PRESENT | PDE_WRITABLE);
+
+            // recheck the pde
+            pde = *pde_entry;
+
+            // check if allocation failed
+            if (!PDE_IS_PRESENT(pde))
+            {
+                // LOG_ERROR("vmm_alloc_region: failed to allocate page table!\n");
+                return _vmm_alloc_region_failed(pdir, start_addr, end_addr);
+            }
+        }
+
+        // already mapped by a large page
+        if (PDE_IS_4MB(pde))
+            continue;
+
+        // from PDE, get address of ptable
+        uint32_t pagetable_phys_addr = PDE_PTABLE_ADDR(pde); 
+
+        pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT(pagetable_phys_addr);
+
+        // find page table entry
+        uint32_t pagetable_i = VMM_TABLE_INDEX(addr);
+
+        pte_t* pte = &(ptable->table[pagetable_i]);
+
+        // check if this frame is already allocated (or in swap)
+        if (PTE_IS_PRESENT(*pte) || (*pte & PTE_SWAPPED))
+            continue;   // skip
+
+        // a batch never spans the user and the kernel half
+        uint32_t page_flags = _vmm_page_flags(addr, flags);
+
+        // lazy: only reserve the page, the fault handler backs it on first touch
+        if (flags & VMM_LAZY)
+        {
+            _vmm_set_pte(pte, page_flags & ~PTE_PRESENT);
+            continue;
+        }
+
+        if (batch_count > 0 && page_flags != batch_flags)
+        {
+            if (!_vmm_fill_ptes(batch, batch_count, batch_flags))
+                return _vmm_alloc_region_failed(pdir, start_addr, end_addr);
+
+            batch_count = 0;
+        }
+
+        batch_flags = page_flags;
+        batch[batch_count++] = pte;
+
+        if (batch_count < VMM_BATCH_FRAMES)
+            continue;
+
+        // allocate cleared frames for the whole batch
+        if (!_vmm_fill_ptes(batch, batch_count, batch_flags))
+        {
+            // LOG_ERROR("vmm_alloc_region: Alloc faliure!\n");
+            return _vmm_alloc_region_failed(pdir, start_addr, end_addr);
+        }
+
+        batch_count = 0;
+    }
+
+    // last partial batch
+    if (batch_count > 0 && !_vmm_fill_ptes(batch, batch_count, batch_flags))
+        return _vmm_alloc_region_failed(pdir, start_addr, end_addr);
+
+    // great success
+    return true;
+
+}
+
+bool vmm_free_region(pagedir_t* pdir, void* virtual, size_t size)
+{
+    // built on vibes...
+
+    // validate parameters
+    if (!pdir || !virtual)
+    {
+        // LOG_ERROR("vmm_free_region: Invalid parameter(s)!\n");
+        return false;
+    }
+
+    if (size == 0)
+    {
+        // LOG_ERROR("vmm_free_region: Size is zero!\n");
+        return false;
+    }
+
+    // compute start and end addr
+    uintptr_t start_addr = (uintptr_t) ALIGN((uintptr_t)virtual, VMM_PAGE_SIZE);
+
+    // why does this alignment work?????
+    // uintptr_t start_addr = ((uintptr_t)virtual) & ~(VMM_PAGE_SIZE - 1);
+
+    uintptr_t end_addr = (uintptr_t) ALIGN((uintptr_t)virtual + size, VMM_PAGE_SIZE);
+
+    uint32_t start_pd_index = VMM_DIR_INDEX(start_addr);
+    uint32_t end_pd_index = VMM_DIR_INDEX(end_addr - 1);
+
+    _vmm_xlate_forget(pdir, start_addr, (end_addr - start_addr) / VMM_PAGE_SIZE);
+
+    // the user half of the range is no longer reserved
+    vma_space_t* space = vma_space_get(pdir, false);
+
+    if (space && start_addr < end_addr && start_addr < VMM_KERNEL_BASE &&
+        !vma_remove_range(space, start_addr, (end_addr > VMM_KERNEL_BASE) ? VMM_KERNEL_BASE : end_addr))
+        LOG_ERROR("vmm_free_region: could not split the VMA at 0x%08x\n", (uint32_t)start_addr);
+
+    // unmapped frames are handed back to kmm in batches
+    void* batch[VMM_BATCH_FRAMES];
+    uint32_t batch_count = 0;
+
+    vmm_tlb_batch_t tlb;
+    vmm_tlb_batch_init(&tlb, pdir);
+
+    // iterate through each page in the region
+    for (uintptr_t addr = start_addr; addr < end_addr; addr += VMM_PAGE_SIZE)
+    {
+        // get page directory entry
+        pde_t* pde_entry = _vmm_get_pde(pdir, addr);
+
+        // skip if page table doesn't exist
+        if (!pde_entry || !PDE_IS_PRESENT(*pde_entry))
+            continue;
+
+        pde_t pde = *pde_entry;
+
+        // large pages are only unmapped when the region covers them whole.
+        // their memory was never allocated from kmm, so nothing is freed
+        if (PDE_IS_4MB(pde))
+        {
+            uintptr_t large_start = addr & ~(VMM_LARGE_PAGE_SIZE - 1);
+
+            if (large_start >= start_addr && end_addr - large_start >= VMM_LARGE_PAGE_SIZE &&
+                !(_vmm_kernel_template_ready && large_start >= VMM_KERNEL_BASE))
+            {
+                *pde_entry = 0;
+                vmm_tlb_batch_add(&tlb, (void*)large_start);
+            }
+
+            // continue after the large page
+            if (end_addr - large_start <= VMM_LARGE_PAGE_SIZE)
+                break;
+
+            addr = large_start + VMM_LARGE_PAGE_SIZE - VMM_PAGE_SIZE;
+            continue;
+        }
+
+        // get the page table
+        uint32_t pagetable_phys_addr = PDE_PTABLE_ADDR(pde);
+        pagetable_t* ptable = (pagetable_t*)PHYS_TO_VIRT(pagetable_phys_addr);
+
+        // get page table index
+        uint32_t pagetable_i = VMM_TABLE_INDEX(addr);
+        pte_t* pte = &(ptable->table[pagetable_i]);
+
+        // check if page is present (a reserved page that was never touched
+        // only loses its reservation, a page in swap its slot)
+        if (!PTE_IS_PRESENT(*pte))
+        {
+            if (*pte & VMM_PTE_RESERVED)
+            {
+                _vmm_swap_drop(*pte);
+                _vmm_set_pte(pte, 0);
+            }
+
+            continue;   // skip
+        }
+
+        // get physical frame address (may be above 4GB with PAE)
+        phys_addr_t frame_phys = (phys_addr_t)PTE_FRAME_ADDR(*pte);
+
+        // clear the page table entry, its TLB entry goes with the batch
+        _vmm_set_pte(pte, 0);
+        vmm_tlb_batch_add(&tlb, (void*)addr);
+
+        // free the frame, frames above 4GB have no pointer and go one by one.
+        // a frame is only reused once no TLB entry points at it
+        if (frame_phys / VMM_PAGE_SIZE >= _KMM_PTR_FRAMES)
+        {
+            vmm_tlb_batch_flush(&tlb);
+            kmm_frame_free_phys(frame_phys);
+            continue;
+        }
+
+        if (!frame_phys || _vmm_unshare_frame(frame_phys))
+            continue;
+
+        batch[batch_count++] = (void*)(uintptr_t)frame_phys;
+
+        if (batch_count == VMM_BATCH_FRAMES)
+        {
+            vmm_tlb_batch_flush(&tlb);
+            kmm_frame_free_batch(batch, batch_count);
+            batch_count = 0;
+        }
+    }
+
+    vmm_tlb_batch_flush(&tlb);
+
+    kmm_frame_free_batch(batch, batch_count);
+
+    // page tables left empty go back to kmm
+    _vmm_free_empty_tables(pdir, start_pd_index, end_pd_index);
+
+    // great success
+    return true;
+}
+
+// frees a table built by a clone that failed: every frame it maps loses the
+// reference the clone took (a private copy goes back to kmm), swap slots it
+// shares are let go. a page of 'src' left holding the last reference to a
+// copy-on-write frame is writable again
+static void _vmm_release_cloned_pagetable(pagetable_t* cloned, pagetable_t* src)
+{
+    for (uint32_t page = 0; page < VMM_PAGES_PER_TABLE; page++)
+    {
+        pte_t pte = cloned->table[page];
+
+        if (!PTE_IS_PRESENT(pte))
+        {
+            _vmm_swap_drop(pte);
+            continue;
+        }
+
+        if (_vmm_is_zero_page(pte))
+            continue;
+
+        phys_addr_t frame_phys = (phys_addr_t)PTE_FRAME_ADDR(pte);
+
+        if (!_vmm_unshare_frame(frame_phys))
+        {
+            kmm_frame_free((void*)(uintptr_t)frame_phys);
+            continue;
+        }
+
+        pte_t src_pte = src->table[page];
+        frame_desc_t* desc = kmm_frame_desc((void*)(uintptr_t)frame_phys);
+
+        if (PTE_IS_PRESENT(src_pte) && (src_pte & PTE_COW) && PTE_FRAME_ADDR(src_pte) == frame_phys &&
+            desc && desc->refcount == 1)
+            src->table[page] = (src_pte & ~(pte_t)PTE_COW) | PTE_WRITABLE;
+    }
+
+    kmm_frame_free(VIRT_TO_PHYS(cloned));
+}
+
+// undoes a clone of the user half of 'src' that failed part way: the tables
+// built for 'newdir' are released, then its VMAs and the directory itself.
+// the caller reloads CR3 when entries of 'src' changed
+static void _vmm_release_clone(pagedir_t* newdir, pagedir_t* src)
+{
+    for (uint32_t i = 0; i < VMM_KERNEL_PDE_FIRST; i++)
+    {
+        pde_t pde = newdir->table[i];
+
+        // shared kernel tables and large pages are the very same entries
+        if (!PDE_IS_PRESENT(pde) || pde == src->table[i])
+            continue;
+
+        _vmm_release_cloned_pagetable((pagetable_t*)PHYS_TO_VIRT((uintptr_t)PDE_PTABLE_ADDR(pde)),
+                                      (pagetable_t*)PHYS_TO_VIRT((uintptr_t)PDE_PTABLE_ADDR(src->table[i])));
+    }
+
+    _vmm_forget_fault_stats(newdir);
+    _vmm_forget_xlate_cache(newdir);
+    vma_space_destroy(newdir);
+
+    kmm_frames_free(VIRT_TO_PHYS(newdir), sizeof(pagedir_t) / VMM_PAGE_SIZE);
+}
+
+pagetable_t* vmm_clone_pagetable(pagetable_t* src)
+{
+    // check null
+    if (!src)
+        return NULL;
+
+    // must be page-aligned (4KB)
+    uintptr_t src_virt = (uintptr_t)src;
+
+    if (src_virt & (VMM_PAGE_SIZE - 1))
+        return NULL;
+
+    // page tables must be accessed via physmap
+    if (src_virt < PHYSMAP_BASE)
+        return NULL;
+
+    // check bounds of physical frame
+    uintptr_t src_physical_addr = (uintptr_t)VIRT_TO_PHYS(src);
+
+    if (src_physical_addr / VMM_PAGE_SIZE >= kmm_get_total_frames())
+        return NULL;
+
+
+    // allocate a new (cleared) physical frame
+    void* new_frame_phys_addr = kmm_frame_alloc_zeroed();
+
+    if (!new_frame_phys_addr)
+    {
+        LOG_ERROR("vmm_clone_pagetable: Alloc failed! (ptable)\n");
+        return NULL;
+    }
+
+    kmm_frame_set_flags(new_frame_phys_addr, KMM_FRAME_PAGETABLE);
+
+    // convert to virtual
+    pagetable_t* cloned_ptable = (pagetable_t*) PHYS_TO_VIRT(new_frame_phys_addr);
+
+    // count the data frames needed, they are taken from kmm in batches
+    uint32_t remaining = 0;
+
+    for (uint32_t page = 0; page < VMM_PAGES_PER_TABLE; page++)
+    {
+        if (PTE_IS_PRESENT(src->table[page]) && !_vmm_is_zero_page(src->table[page]))
+            remaining++;
+    }
+
+    void* frames[VMM_BATCH_FRAMES];
+    uint32_t batch_count = 0;
+    uint32_t batch_i = 0;
+
+    // iterate over all pages in the table
+    for (uint32_t page = 0; page < VMM_PAGES_PER_TABLE; page++)
+    {
+        // get each entry in src
+        pte_t pte = src->table[page];
+
+        // check if present (reservations carry over as they are, a page in
+        // swap shares its slot)
+        if (!PTE_IS_PRESENT(pte))
+        {
+            if (pte & VMM_PTE_RESERVED)
+            {
+                _vmm_swap_share(pte);
+                _vmm_set_pte(&cloned_ptable->table[page], pte);
+            }
+
+            continue;   // skip
+        }
+
+        // pages only read so far keep sharing the zero frame
+        if (_vmm_is_zero_page(pte))
+        {
+            _vmm_set_pte(&cloned_ptable->table[page], pte);
+            continue;
+        }
+
+        // refill the batch of new physical frames for the data
+        if (batch_i == batch_count)
+        {
+            batch_count = kmm_frame_alloc_batch(frames, (remaining < VMM_BATCH_FRAMES) ? remaining : VMM_BATCH_FRAMES);
+            batch_i = 0;
+
+            remaining -= batch_count;
+        }
+
+        if (batch_i == batch_count)
+        {
+            LOG_ERROR("vmm_clone_pagetable: Alloc failed! (page)\n");
+
+            // nothing half copied is handed out
+            _vmm_release_cloned_pagetable(cloned_ptable, src);
+            return NULL;
+        }
+
+        // the refill may have sent the page to swap
+        pte = src->table[page];
+
+        if (!PTE_IS_PRESENT(pte))
+        {
+            _vmm_swap_share(pte);
+            _vmm_set_pte(&cloned_ptable->table[page], pte);
+            continue;
+        }
+
+        void* new_page_phys_addr = frames[batch_i++];
+
+        // get original flags (a copy-on-write share becomes a private page)
+        uint32_t src_flags = PTE_FLAGS(pte);
+
+        if (src_flags & PTE_COW)
+            src_flags = (src_flags & ~PTE_COW) | PTE_WRITABLE;
+
+        // get virtuals
+        void* src_virt_addr = PHYS_TO_VIRT((uintptr_t)PTE_FRAME_ADDR(pte));
+        void* dst_virt_addr = PHYS_TO_VIRT(new_page_phys_addr);
+
+        // copy
+        memcpy(dst_virt_addr, src_virt_addr, VMM_PAGE_SIZE);
+
+        _vmm_track_frame(new_page_phys_addr, src_flags);
+
+        // create new entry for cloned table (same flags)
+        pte_t new_entry = _pte_create(new_page_phys_addr, src_flags);
+
+        _vmm_set_pte(&cloned_ptable->table[page], new_entry);
+    }
+
+    // frames of pages that went to swap meanwhile
+    kmm_frame_free_batch(&frames[batch_i], batch_count - batch_i);
+
+    return cloned_ptable;
+}
+
+pagedir_t* vmm_clone_pagedir(void)
+{
+    // built on vibes...
+
+    // get current and kernel pagedirs
+    // mutuallu exclusive options
+    pagedir_t* curr = vmm_get_current_pagedir();
+    pagedir_t* kdir = vmm_get_kerneldir();
+
+    if (!curr)
+        return NULL;
+
+    // create a new empty page directory
+    pagedir_t* newdir = vmm_create_address_space();
+
+    if (!newdir)
+        return NULL;
+
+    // the clone reserves the same ranges. done first, a failure later on
+    // only has pages to undo
+    if (!vma_space_clone(curr, newdir))
+    {
+        _vmm_release_clone(newdir, curr);
+        return NULL;
+    }
+
+    // the kernel half came with the new directory, only the user half is walked
+    for (uint32_t i = 0; i < VMM_KERNEL_PDE_FIRST; i++)
+    {
+        pde_t src_pde = curr->table[i];
+
+        // skip not-present entries
+        if (!PDE_IS_PRESENT(src_pde))
+            continue;
+
+        // if kernel mapping (or a large page, which has no table to clone), shallow copy
+        if (PDE_IS_4MB(src_pde) || (PDE_IS_PRESENT(kdir->table[i]) && PDE_PTABLE_ADDR(kdir->table[i]) == PDE_PTABLE_ADDR(src_pde)))
+            // copy src pde
+            newdir->table[i] = src_pde;
+
+        else
+        {
+            // user mapping branch
+            uint32_t src_pt_phys = PDE_PTABLE_ADDR(src_pde);
+            pagetable_t* src_pt = (pagetable_t*)PHYS_TO_VIRT(src_pt_phys);
+
+            // clone page table
+            pagetable_t* cloned_pt = vmm_clone_pagetable(src_pt);
+
+            if (!cloned_pt)
+            {
+                LOG_ERROR("vmm_clone_pagedir: failed to clone PT at PDE %u\n", i);
+
+                _vmm_release_clone(newdir, curr);
+                return NULL;
+            }
+
+            // preserve flags
+            uint32_t pde_flags = PDE_FLAGS(src_pde);
+            pde_t new_pde = _pde_create(VIRT_TO_PHYS(cloned_pt), pde_flags);
+
+            // assign new pde
+            newdir->table[i] = new_pde;
+        }
+    }
+
+    return newdir;
+}
+
+// copy-on-write counterpart of vmm_clone_pagetable: the new table maps the
+// same frames, each gaining a reference. writable pages turn read-only and
+// PTE_COW in both tables. frames kmm does not track are copied right away
+static pagetable_t* _vmm_share_pagetable(pagetable_t* src)
+{
+    void* new_frame_phys_addr = kmm_frame_alloc_zeroed();
+
+    if (!new_frame_phys_addr)
+    {
+        LOG_ERROR("_vmm_share_pagetable: Alloc failed! (ptable)\n");
+        return NULL;
+    }
+
+    kmm_frame_set_flags(new_frame_phys_addr, KMM_FRAME_PAGETABLE);
+
+    pagetable_t* shared_ptable = (pagetable_t*) PHYS_TO_VIRT(new_frame_phys_addr);
+
+    for (uint32_t page = 0; page < VMM_PAGES_PER_TABLE; page++)
+    {
+        pte_t pte = src->table[page];
+
+        // reservations carry over as they are, a page in swap shares its slot
+        if (!PTE_IS_PRESENT(pte))
+        {
+            if (pte & VMM_PTE_RESERVED)
+            {
+                _vmm_swap_share(pte);
+                _vmm_set_pte(&shared_ptable->table[page], pte);
+            }
+
+            continue;   // skip
+        }
+
+        // pages only read so far keep sharing the zero frame
+        if (_vmm_is_zero_page(pte))
+        {
+            _vmm_set_pte(&shared_ptable->table[page], pte);
+            continue;
+        }
+
+        phys_addr_t frame_phys = (phys_addr_t)PTE_FRAME_ADDR(pte);
+
+        // no pointer (and no descriptor) for frames above 4GB
+        if (frame_phys / VMM_PAGE_SIZE >= _KMM_PTR_FRAMES)
+        {
+            LOG_ERROR("_vmm_share_pagetable: frame above 4GB not cloned\n");
+            continue;
+        }
+
+        void* frame = (void*)(uintptr_t)frame_phys;
+        frame_desc_t* desc = kmm_frame_desc(frame);
+
+        if (!desc || desc->refcount == 0)
+        {
+            void* copy = kmm_frame_alloc();
+
+            if (!copy)
+            {
+                LOG_ERROR("_vmm_share_pagetable: Alloc failed! (page)\n");
+
+                // nothing half shared is handed out
+                _vmm_release_cloned_pagetable(shared_ptable, src);
+                return NULL;
+            }
+
+            kmm_frame_copy(copy, frame);
+            _vmm_track_frame(copy, PTE_FLAGS(pte));
+
+            _vmm_set_pte(&shared_ptable->table[page], _pte_create(copy, PTE_FLAGS(pte)));
+            continue;
+        }
+
+        kmm_frame_get(frame);
+        desc->mapcount += 1;
+
+        if (pte & (PTE_WRITABLE | PTE_COW))
+        {
+            pte = (pte & ~(pte_t)PTE_WRITABLE) | PTE_COW;
+            src->table[page] = pte;
+        }
+
+        _vmm_set_pte(&shared_ptable->table[page], pte);
+    }
+
+    return shared_ptable;
+}
+
+pagedir_t* vmm_clone_pagedir_cow(void)
+{
+    pagedir_t* curr = vmm_get_current_pagedir();
+    pagedir_t* kdir = vmm_get_kerneldir();
+
+    if (!curr)
+        return NULL;
+
+    // kernel half comes with the new directory
+    pagedir_t* newdir = vmm_create_address_space();
+
+    if (!newdir)
+        return NULL;
+
+    // the clone reserves the same ranges. done first, a failure later on
+    // only has pages to undo
+    if (!vma_space_clone(curr, newdir))
+    {
+        _vmm_release_clone(newdir, curr);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < VMM_KERNEL_PDE_FIRST; i++)
+    {
+        pde_t src_pde = curr->table[i];
+
+        if (!PDE_IS_PRESENT(src_pde))
+            continue;
+
+        // kernel tables and large pages are shared as they are
+        if (PDE_IS_4MB(src_pde) || (PDE_IS_PRESENT(kdir->table[i]) && PDE_PTABLE_ADDR(kdir->table[i]) == PDE_PTABLE_ADDR(src_pde)))
+        {
+            newdir->table[i] = src_pde;
+            continue;
+        }
+
+        pagetable_t* src_pt = (pagetable_t*)PHYS_TO_VIRT((uintptr_t)PDE_PTABLE_ADDR(src_pde));
+        pagetable_t* shared_pt = _vmm_share_pagetable(src_pt);
+
+        if (!shared_pt)
+        {
+            LOG_ERROR("vmm_clone_pagedir_cow: failed to share PT at PDE %u\n", i);
+
+            // the references taken so far go, the current space gets its
+            // write access back and drops the read-only entries it cached
+            _vmm_release_clone(newdir, curr);
+            vmm_switch_pagedir(curr);
+
+            return NULL;
+        }
+
+        newdir->table[i] = _pde_create(VIRT_TO_PHYS(shared_pt), PDE_FLAGS(src_pde));
+    }
+
+    // the current space just lost write access to its shared pages
+    vmm_switch_pagedir(curr);
+
+    return newdir;
+}
+
+void vmm_get_fault_stats(pagedir_t* pdir, vmm_fault_stats_t* stats)
+{
+    if (!stats)
+        return;
+
+    memset(stats, 0, sizeof(vmm_fault_stats_t));
+
+    // address spaces that never faulted have no slot
+    for (uint32_t i = 0; pdir && i < VMM_FAULT_STAT_SLOTS; i++)
+    {
+        if (_vmm_fault_slots[i].pdir == pdir)
+        {
+            *stats = _vmm_fault_slots[i].stats;
+            break;
+        }
+    }
+}
+
+void vmm_tlb_batch_init(vmm_tlb_batch_t* batch, pagedir_t* pdir)
+{
+    batch->pdir = pdir;
+    batch->count = 0;
+    batch->kernel = false;
+}
+
+void vmm_tlb_batch_add(vmm_tlb_batch_t* batch, void* virtual)
+{
+    uintptr_t page = (uintptr_t)virtual & ~(uintptr_t)(VMM_PAGE_SIZE - 1);
+
+    // the user half of an address space that is not loaded has nothing
+    // cached, the switch to it flushes anyway
+    if (page < VMM_KERNEL_BASE && batch->pdir != _vmm_current_pagedir)
+        return;
+
+    if (page >= VMM_KERNEL_BASE)
+        batch->kernel = true;
+
+    if (batch->count < VMM_TLB_BATCH_MAX)
+        batch->pages[batch->count] = page;
+
+    batch->count++;
+}
+
+// drops every TLB entry. a CR3 reload keeps global entries, clearing and
+// setting CR4.PGE drops those too
+static void _vmm_flush_tlb_all(bool global)
+{
+    if (global && _vmm_global_pages)
+    {
+        uint32_t cr4_value;
+
+        asm volatile ("mov %%cr4, %0" : "=r"(cr4_value));
+        asm volatile ("mov %0, %%cr4" :: "r"(cr4_value & ~0x80u) : "memory");
+        asm volatile ("mov %0, %%cr4" :: "r"(cr4_value) : "memory");
+
+        return;
+    }
+
+    uint32_t cr3_value;
+
+    asm volatile ("mov %%cr3, %0" : "=r"(cr3_value));
+    asm volatile ("mov %0, %%cr3" :: "r"(cr3_value) : "memory");
+}
+
+void vmm_tlb_batch_flush(vmm_tlb_batch_t* batch)
+{
+    if (batch->count == 0)
+        return;
+
+    if (batch->count > _vmm_tlb_flush_threshold)
+        _vmm_flush_tlb_all(batch->kernel);
+    else
+    {
+        for (uint32_t i = 0; i < batch->count; i++)
+            flush_tlb((void*)batch->pages[i]);
+    }
+
+    batch->count = 0;
+    batch->kernel = false;
+}
+
+void vmm_set_tlb_flush_threshold(uint32_t pages)
+{
+    _vmm_tlb_flush_threshold = (pages > VMM_TLB_BATCH_MAX) ? VMM_TLB_BATCH_MAX : pages;
+}
+
+uint32_t vmm_get_tlb_flush_threshold(void)
+{
+    return _vmm_tlb_flush_threshold;
+}
 
-    uintptr_t end_addr = (uintptr_t) ALIGN((uintptr_t)virtual + size, VMM_PAGE_SIZE);
+// samples the accessed and dirty bits of the present pages of 'vma' and
+// clears the accessed bits, so the next scan sees only newer accesses.
+// pages mapping the shared zero frame hold no memory and are not counted.
+// the dirty bits are left alone, they are all that tells a written page
+// from a clean one. the cleared entries are queued on 'tlb', a cached
+// translation would not set the bit again
+static void _vmm_ws_scan_vma(pagedir_t* pdir, vma_t* vma, vmm_tlb_batch_t* tlb)
+{
+    uint32_t resident = 0, referenced = 0, dirty = 0;
+    uintptr_t addr = vma->start;
 
-    // iterate through addr
-    for (uintptr_t addr = start_addr; addr < end_addr; addr += VMM_PAGE_SIZE)
+    while (addr < vma->end)
     {
-        // for each addr:
-        // 1) get page table address (create if not found)
-        // 2) allocate frame
-        // 3) set PTE
+        // the part of the VMA under this PDE
+        uintptr_t next = (addr & ~(uintptr_t)(VMM_LARGE_PAGE_SIZE - 1)) + VMM_LARGE_PAGE_SIZE;
 
-        // get pagedir entry
-        uint32_t pagedir_i = VMM_DIR_INDEX(addr);
+        if (next > vma->end)
+            next = vma->end;
 
-        // get PDE
-        pde_t pde = pdir->table[pagedir_i];
+        pde_t* pde = _vmm_get_pde(pdir, addr);
 
-        // check if a page table is present
-        if (!PDE_IS_PRESENT(pde))
+        if (!pde || !PDE_IS_PRESENT(*pde))
         {
-            // create a page table
-            vmm_create_pt(pdir, (void*)addr, PDE_PRESENT | PDE_WRITABLE);
+            addr = next;
+            continue;
+        }
+
+        // a large page is sampled as a whole
+        if (PDE_IS_4MB(*pde))
+        {
+            uint32_t pages = (next - addr) / VMM_PAGE_SIZE;
 
-            // recheck pde at pagedir_i
-            pde = pdir->table[pagedir_i];
+            resident += pages;
 
-            // check if allocation failed
-            if (!PDE_IS_PRESENT(pde))
+            if (PDE_IS_DIRTY(*pde))
+                dirty += pages;
+
+            if (*pde & PDE_ACCESSED)
             {
-                // LOG_ERROR("vmm_alloc_region: failed to allocate page table!\n");
-                return false;
+                referenced += pages;
+                *pde &= ~(pde_t)PDE_ACCESSED;
+                vmm_tlb_batch_add(tlb, (void*)addr);
             }
-        }
 
-        // from PDE, get address of ptable
-        uint32_t pagetable_phys_addr = PDE_PTABLE_ADDR(pde); 
+            addr = next;
+            continue;
+        }
 
-        pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT(pagetable_phys_addr);
+        pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT((uintptr_t)PDE_PTABLE_ADDR(*pde));
 
-        // find page table entry
-        uint32_t pagetable_i = VMM_TABLE_INDEX(addr);
+        // nothing mapped through this table
+        if (_vmm_pt_used(ptable) == 0)
+        {
+            addr = next;
+            continue;
+        }
 
-        pte_t* pte = &(ptable->table[pagetable_i]);
+        for (; addr < next; addr += VMM_PAGE_SIZE)
+        {
+            pte_t* pte = &ptable->table[VMM_TABLE_INDEX(addr)];
 
-        // check if this frame is already allocated
-        if (PTE_IS_PRESENT(*pte))
-            continue;   // skip
+            if (!PTE_IS_PRESENT(*pte) || _vmm_is_zero_page(*pte))
+                continue;
 
+            resident++;
 
-        // allocate a frame
-        void* frame_physical_addr = kmm_frame_alloc();
+            if (PTE_IS_DIRTY(*pte))
+                dirty++;
 
-        // validate
-        if (!frame_physical_addr)
-        {
-            // LOG_ERROR("vmm_alloc_region: Alloc faliure!\n");
-            return false;
+            if (*pte & PTE_ACCESSED)
+            {
+                referenced++;
+                *pte &= ~(pte_t)PTE_ACCESSED;
+                vmm_tlb_batch_add(tlb, (void*)addr);
+            }
         }
+    }
+
+    vma->resident = resident;
+    vma->referenced = referenced;
+    vma->dirty = dirty;
+    vma->heat = vma->heat / 2 + referenced;
+    vma->age = referenced ? 0 : vma->age + 1;
+}
+
+void vmm_ws_scan(pagedir_t* pdir)
+{
+    vma_space_t* space = vma_space_get(pdir, false);
+
+    if (!space)
+        return;
+
+    vmm_ws_stats_t* ws = &space->ws;
+    vmm_tlb_batch_t tlb;
 
-        // clear out the memory
-        memset(PHYS_TO_VIRT(frame_physical_addr), 0, VMM_PAGE_SIZE);
+    vmm_tlb_batch_init(&tlb, pdir);
 
-        // assign to ptable
-        pte_t new_entry = _pte_create(frame_physical_addr, flags);
+    ws->resident = 0;
+    ws->working_set = 0;
+    ws->dirty = 0;
 
-        *pte = new_entry;
+    for (vma_t* vma = vma_next(space, 0); vma; vma = vma_next(space, vma->end))
+    {
+        _vmm_ws_scan_vma(pdir, vma, &tlb);
 
+        ws->resident += vma->resident;
+        ws->working_set += vma->referenced;
+        ws->dirty += vma->dirty;
     }
 
-    // great success
-    return true;
+    vmm_tlb_batch_flush(&tlb);
 
+    ws->scans++;
 }
 
-bool vmm_free_region(pagedir_t* pdir, void* virtual, size_t size)
+bool vmm_ws_scan_idle(void)
 {
-    // built on vibes...
+    // meant for idle time: scans every address space with VMAs once per
+    // VMM_WS_SCAN_CYCLES, returns whether it did
+    uint64_t now = rdtsc();
 
-    // validate parameters
-    if (!pdir || !virtual)
-    {
-        // LOG_ERROR("vmm_free_region: Invalid parameter(s)!\n");
+    if (_vmm_ws_last_idle_scan && now - _vmm_ws_last_idle_scan < VMM_WS_SCAN_CYCLES)
         return false;
-    }
 
-    if (size == 0)
-    {
-        // LOG_ERROR("vmm_free_region: Size is zero!\n");
-        return false;
-    }
+    for (vma_space_t* space = vma_space_next(NULL); space; space = vma_space_next(space))
+        vmm_ws_scan(space->pdir);
 
-    // compute start and end addr
-    uintptr_t start_addr = (uintptr_t) ALIGN((uintptr_t)virtual, VMM_PAGE_SIZE);
+    _vmm_ws_last_idle_scan = now;
 
-    // why does this alignment work?????
-    // uintptr_t start_addr = ((uintptr_t)virtual) & ~(VMM_PAGE_SIZE - 1);
+    return true;
+}
 
-    uintptr_t end_addr = (uintptr_t) ALIGN((uintptr_t)virtual + size, VMM_PAGE_SIZE);
+bool vmm_get_ws_stats(pagedir_t* pdir, vmm_ws_stats_t* stats)
+{
+    vma_space_t* space = vma_space_get(pdir, false);
 
-    uint32_t start_pd_index = VMM_DIR_INDEX(start_addr);
-    uint32_t end_pd_index = VMM_DIR_INDEX(end_addr - 1);
+    if (!space || !stats)
+        return false;
 
-    // iterate through each page in the region
-    for (uintptr_t addr = start_addr; addr < end_addr; addr += VMM_PAGE_SIZE)
-    {
-        // get page directory index
-        uint32_t pagedir_i = VMM_DIR_INDEX(addr);
-        pde_t pde = pdir->table[pagedir_i];
+    *stats = space->ws;
 
-        // skip if page table doesn't exist
-        if (!PDE_IS_PRESENT(pde))
-            continue;
+    return true;
+}
 
-        // get the page table
-        uint32_t pagetable_phys_addr = PDE_PTABLE_ADDR(pde);
-        pagetable_t* ptable = (pagetable_t*)PHYS_TO_VIRT(pagetable_phys_addr);
+// a page reclaim may send to swap: present, private (not shared copy-on-write
+// or mapped twice) and in a data frame kmm tracks
+static inline bool _vmm_evictable(pte_t pte)
+{
+    if (!PTE_IS_PRESENT(pte) || (pte & PTE_COW))
+        return false;
 
-        // get page table index
-        uint32_t pagetable_i = VMM_TABLE_INDEX(addr);
-        pte_t* pte = &(ptable->table[pagetable_i]);
+    phys_addr_t frame_phys = (phys_addr_t)PTE_FRAME_ADDR(pte);
 
-        // check if page is present
-        if (!PTE_IS_PRESENT(*pte))
-            continue;   // skip
+    if (frame_phys / VMM_PAGE_SIZE >= _KMM_PTR_FRAMES)
+        return false;
 
-        // get physical frame address
-        void* frame_phys = (void*)PTE_FRAME_ADDR(*pte);
+    frame_desc_t* desc = kmm_frame_desc((void*)(uintptr_t)frame_phys);
 
-        // free the frame
-        if (frame_phys)
-            kmm_frame_free(frame_phys);
+    return desc && desc->refcount == 1 && desc->mapcount <= 1 &&
+           !(desc->flags & (KMM_FRAME_KERNEL | KMM_FRAME_PAGETABLE | KMM_FRAME_HEAP | KMM_FRAME_RESERVED));
+}
 
-        // clear the page table entry
-        *pte = 0;
+// one sweep of the clock over the VMAs of 'space' from '*addr', until
+// 'pages' pages are in swap or the space ends ('*addr' is then 0). a page
+// accessed since the hand last passed only loses its accessed bit
+static uint32_t _vmm_evict_from(vma_space_t* space, uintptr_t* addr, uint32_t pages)
+{
+    pagedir_t* pdir = space->pdir;
+    uintptr_t virt = *addr;
+    uint32_t evicted = 0;
 
-        // invalidate TLB entry
-        flush_tlb((void*)addr);
-    }
+    void* frames[VMM_BATCH_FRAMES];
+    uint32_t frame_count = 0;
 
-    // check for empty page tables and free them
-    bool freed_any_pt = false;
-    for (uint32_t pd_index = start_pd_index; pd_index <= end_pd_index; pd_index++)
-    {
-        pde_t pde = pdir->table[pd_index];
+    vmm_tlb_batch_t tlb;
+    vmm_tlb_batch_init(&tlb, pdir);
 
-        // skip if page table doesn't exist
-        if (!PDE_IS_PRESENT(pde))
-            continue;
+    vma_t* vma = vma_next(space, virt);
 
-        // get the page table
-        uint32_t pagetable_phys_addr = PDE_PTABLE_ADDR(pde);
-        pagetable_t* ptable = (pagetable_t*) PHYS_TO_VIRT(pagetable_phys_addr);
+    for (; vma && evicted < pages; vma = vma_next(space, virt))
+    {
+        if (virt < vma->start)
+            virt = vma->start;
 
-        // check if page table is completely empty
-        bool is_empty = true;
-        for (uint32_t i = 0; i < VMM_PAGES_PER_TABLE; i++)
+        for (; virt < vma->end && evicted < pages; virt += VMM_PAGE_SIZE)
         {
-            if (PTE_IS_PRESENT(ptable->table[i]))
+            pte_t* pte = _vmm_find_pte(pdir, virt);
+
+            // no table here, on to the last page it would have covered
+            if (!pte)
             {
-                is_empty = false;
-                break;
+                virt |= VMM_LARGE_PAGE_SIZE - VMM_PAGE_SIZE;
+                continue;
             }
-        }
 
-        // if empty, free the page table
-        if (is_empty)
-        {
-            // LOG_DEBUG("vmm_free_region: Freeing empty page table at PD index %u\n", pd_index);
+            if (!_vmm_evictable(*pte))
+                continue;
 
-            // free page table frame
-            kmm_frame_free((void*)pagetable_phys_addr);
+            if (*pte & PTE_ACCESSED)
+            {
+                *pte &= ~(pte_t)PTE_ACCESSED;
+                vmm_tlb_batch_add(&tlb, (void*)virt);
+                continue;
+            }
 
-            // clear the page directory entry
-            pdir->table[pd_index] = 0;
-            freed_any_pt = true;
-        }
-    }
+            uint32_t slot = swap_slot_alloc();
 
-    // great success
-    return true;
-}
+            // swap is full, nothing more to do
+            if (slot == SWAP_NO_SLOT)
+            {
+                pages = evicted;
+                break;
+            }
 
-pagetable_t* vmm_clone_pagetable(pagetable_t* src)
-{
-    // check null
-    if (!src)
-        return NULL;
+            uint32_t start = (uint32_t)rdtsc();
+            void* frame = (void*)(uintptr_t)PTE_FRAME_ADDR(*pte);
 
-    // must be page-aligned (4KB)
-    uintptr_t src_virt = (uintptr_t)src;
+            swap_write(slot, frame);
 
-    if (src_virt & (VMM_PAGE_SIZE - 1))
-        return NULL;
+            _vmm_set_pte(pte, _vmm_swap_entry(slot, (uint32_t)PTE_FLAGS(*pte)));
+            _vmm_xlate_forget(pdir, virt, 1);
+            vmm_tlb_batch_add(&tlb, (void*)virt);
 
-    // page tables must be accessed via physmap
-    if (src_virt < PHYSMAP_BASE)
-        return NULL;
+            frames[frame_count++] = frame;
+            evicted++;
 
-    // check bounds of physical frame
-    uintptr_t src_physical_addr = (uintptr_t)VIRT_TO_PHYS(src);
+            // a frame is only reused once no TLB entry points at it
+            if (frame_count == VMM_BATCH_FRAMES)
+            {
+                vmm_tlb_batch_flush(&tlb);
+                kmm_frame_free_batch(frames, frame_count);
+                frame_count = 0;
+            }
 
-    if (src_physical_addr >= kmm_get_total_frames() * VMM_PAGE_SIZE)
-        return NULL;
+            _vmm_swap_stats.evict_cycles += (uint32_t)rdtsc() - start;
+        }
+    }
 
+    vmm_tlb_batch_flush(&tlb);
+    kmm_frame_free_batch(frames, frame_count);
 
-    // allocate a new physical frame
-    void* new_frame_phys_addr = kmm_frame_alloc();
+    _vmm_swap_stats.evictions += evicted;
 
-    if (!new_frame_phys_addr)
-    {
-        LOG_ERROR("vmm_clone_pagetable: Alloc failed! (ptable)\n");
-        return NULL;
-    }
+    // past the last VMA, the next sweep starts at the next space
+    *addr = vma ? virt : 0;
 
-    // convert to virtual
-    pagetable_t* cloned_ptable = (pagetable_t*) PHYS_TO_VIRT(new_frame_phys_addr);
+    return evicted;
+}
 
-    // clear it
-    memset(cloned_ptable, 0, sizeof(pagetable_t));
+uint32_t vmm_reclaim(uint32_t pages)
+{
+    swap_stats_t swap;
+    swap_get_stats(&swap);
 
-    // iterate over all pages in the table
-    for (uint32_t page = 0; page < VMM_PAGES_PER_TABLE; page++)
-    {
-        // get each entry in src
-        pte_t pte = src->table[page];
+    if (swap.used == swap.slots || pages == 0)
+        return 0;
 
-        // check if present
-        if (!PTE_IS_PRESENT(pte))
-            continue;   // skip
+    // the hand goes around every space twice at most: a page only skipped
+    // for its accessed bit on the first pass is taken on the second
+    uint32_t spaces = 0;
+
+    for (vma_space_t* space = vma_space_next(NULL); space; space = vma_space_next(space))
+        spaces++;
+
+    vma_space_t* space = vma_space_get(_vmm_reclaim_pdir, false);
+
+    // the space the hand was in is gone
+    if (!space)
+        _vmm_reclaim_addr = 0;
 
-        // allocate a new physical frame for the data
-        void* new_page_phys_addr = kmm_frame_alloc();
+    uint32_t evicted = 0;
 
-        if (!new_page_phys_addr)
+    for (uint32_t visits = 0; visits <= 2 * spaces && evicted < pages; visits++)
+    {
+        if (!space)
         {
-            LOG_ERROR("vmm_clone_pagetable: Alloc failed! (page)\n");
-            break;  // stop cloning
-        }
+            space = vma_space_next(NULL);
 
-        // get original flags
-        uint32_t src_flags = PTE_FLAGS(pte);
+            if (!space)
+                break;
+        }
 
-        // get virtuals
-        void* src_virt_addr = PHYS_TO_VIRT((void*)PTE_FRAME_ADDR(pte));
-        void* dst_virt_addr = PHYS_TO_VIRT(new_page_phys_addr);
+        evicted += _vmm_evict_from(space, &_vmm_reclaim_addr, pages - evicted);
 
-        // copy
-        memcpy(dst_virt_addr, src_virt_addr, VMM_PAGE_SIZE);
+        if (_vmm_reclaim_addr == 0)
+            space = vma_space_next(space);
 
-        // create new entry for cloned table (same flags)
-        pte_t new_entry = _pte_create(new_page_phys_addr, src_flags);
+        // no slot left for the spaces after this one
+        swap_get_stats(&swap);
 
-        cloned_ptable->table[page] = new_entry;
+        if (swap.used == swap.slots)
+            break;
     }
 
-    return cloned_ptable;
+    // the hand stays where it stopped, or at the start of the next space
+    _vmm_reclaim_pdir = space ? space->pdir : NULL;
+
+    return evicted;
 }
 
-pagedir_t* vmm_clone_pagedir(void)
+// like vmm_reclaim, limited to the space of 'pdir' and swept from its first
+// VMA: the global hand is neither used nor moved
+uint32_t vmm_reclaim_space(pagedir_t* pdir, uint32_t pages)
 {
-    // built on vibes...
-
-    // get current and kernel pagedirs
-    // mutuallu exclusive options
-    pagedir_t* curr = vmm_get_current_pagedir();
-    pagedir_t* kdir = vmm_get_kerneldir();
+    swap_stats_t swap;
+    swap_get_stats(&swap);
 
-    if (!curr)
-        return NULL;
+    vma_space_t* space = vma_space_get(pdir, false);
 
-    // create a new empty page directory
-    pagedir_t* newdir = vmm_create_address_space();
+    if (!space || swap.used == swap.slots || pages == 0)
+        return 0;
 
-    if (!newdir)
-        return NULL;
+    uint32_t evicted = 0;
 
-    // iterate through all PDEs
-    for (uint32_t i = 0; i < 1024; i++)
+    for (uint32_t pass = 0; pass < 2 && evicted < pages; pass++)
     {
-        pde_t src_pde = curr->table[i];
-
-        // skip not-present entries
-        if (!PDE_IS_PRESENT(src_pde))
-            continue;
+        uintptr_t addr = 0;
 
-        // if kernel mapping, shallow copy page table
-        if (PDE_IS_PRESENT(kdir->table[i]) && PDE_PTABLE_ADDR(kdir->table[i]) == PDE_PTABLE_ADDR(src_pde))
-            // copy src pde
-            newdir->table[i] = src_pde;
+        evicted += _vmm_evict_from(space, &addr, pages - evicted);
 
-        else
-        {
-            // user mapping branch
-            uint32_t src_pt_phys = PDE_PTABLE_ADDR(src_pde);
-            pagetable_t* src_pt = (pagetable_t*)PHYS_TO_VIRT(src_pt_phys);
+        swap_get_stats(&swap);
 
-            // clone page table
-            pagetable_t* cloned_pt = vmm_clone_pagetable(src_pt);
+        if (swap.used == swap.slots)
+            break;
+    }
 
-            if (!cloned_pt)
-            {
-                LOG_ERROR("vmm_clone_pagedir: failed to clone PT at PDE %u\n", i);
-                return NULL;
-            }
+    return evicted;
+}
 
-            // preserve flags
-            uint32_t pde_flags = PDE_FLAGS(src_pde);
-            pde_t new_pde = _pde_create(VIRT_TO_PHYS(cloned_pt), pde_flags);
+// kmm's reclaim handler: at least a batch, so the next few allocations
+// do not have to come back
+static uint32_t _vmm_reclaim_frames(uint32_t frames)
+{
+    return vmm_reclaim((frames > VMM_RECLAIM_BATCH) ? frames : VMM_RECLAIM_BATCH);
+}
 
-            // assign new pde
-            newdir->table[i] = new_pde;
-        }
-    }
+void vmm_set_reclaim_watermark(uint32_t frames)
+{
+    kmm_set_reclaim_handler(_vmm_reclaim_frames, frames);
+}
 
-    return newdir;
+void vmm_get_swap_stats(vmm_swap_stats_t* stats)
+{
+    if (stats)
+        *stats = _vmm_swap_stats;
 }
 
 // helpers
@@ -679,15 +2891,40 @@ bool vmm_switch_pagedir(pagedir_t* new_pagedir)
 
     uint32_t pagedir_phys_addr = (uint32_t) VIRT_TO_PHYS(new_pagedir);
 
+#ifdef VMM_PAE
+    // the boot tables are 32-bit, the first switch also turns PAE on
+    if (!_vmm_pae_active)
+    {
+        _vmm_enable_pae(pagedir_phys_addr);
+        _vmm_current_pagedir = new_pagedir;
+
+#ifdef VMM_RECURSIVE
+        _vmm_recursive_loaded = true;
+#endif
+
+        return true;
+    }
+#endif
+
     // store in %CR3
     asm volatile ("mov %0, %%cr3" :: "r"(pagedir_phys_addr));
 
     // set global state
     _vmm_current_pagedir = new_pagedir;
 
+#ifdef VMM_RECURSIVE
+    // every directory we hand out maps itself
+    _vmm_recursive_loaded = true;
+#endif
+
     return true;
 }
 
+uint64_t vmm_get_boot_map_cycles(void)
+{
+    return _vmm_boot_map_cycles;
+}
+
 void vmm_read_cr3(void)
 {
     uint32_t cr3_value;
@@ -697,7 +2934,41 @@ void vmm_read_cr3(void)
 
     // set global state
     _vmm_current_pagedir = (pagedir_t*) PHYS_TO_VIRT(cr3_value);
-    
+
+#ifdef VMM_RECURSIVE
+    // may be the boot directory, which does not map itself
+    _vmm_recursive_loaded = false;
+#endif
+}
+
+bool vmm_pae_enabled(void)
+{
+    uint32_t cr4_value;
+
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4_value));
+
+    // CR4.PAE
+    return (cr4_value & 0x20) != 0;
+}
+
+bool vmm_pse_enabled(void)
+{
+    uint32_t cr4_value;
+
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4_value));
+
+    // CR4.PSE
+    return (cr4_value & 0x10) != 0;
+}
+
+bool vmm_pge_enabled(void)
+{
+    uint32_t cr4_value;
+
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4_value));
+
+    // CR4.PGE
+    return (cr4_value & 0x80) != 0;
 }
 
 static inline void flush_tlb(void* virt)
@@ -5,28 +5,7 @@
 
 #include <testmain.h>
 #include <mm/kmm.h>
-
-/* Minimal unsigned int → string converter */
-static void utoa(unsigned val, char *buf) {
-    char tmp[16];
-    int i = 0, j = 0;
-
-    if (val == 0) {
-        buf[0] = '0';
-        buf[1] = '\0';
-        return;
-    }
-
-    while (val > 0 && i < (int)sizeof(tmp)) {
-        tmp[i++] = '0' + (val % 10);
-        val /= 10;
-    }
-
-    while (i > 0) {
-        buf[j++] = tmp[--i];
-    }
-    buf[j] = '\0';
-}
+#include <utils.h>
 
 #define ASSERT_TRUE(expr, msg) do {                        \
     if (!(expr)) {                                         \
@@ -377,4 +356,495 @@ void test_kmm_free_invalid()
 
     strcat(dbg, " PASSED");
     send_msg(dbg);
-}
\ No newline at end of file
+}
+
+/* ---------------- Contiguous Allocation Tests ---------------- */
+void test_kmm_frames_alloc()
+{
+    ensure_kmm_initialized();
+
+    uint32_t used_before = kmm_get_used_frames();
+
+    /* invalid requests */
+    ASSERT_TRUE(kmm_frames_alloc(0, 1) == NULL, "count 0 should fail");
+    ASSERT_TRUE(kmm_frames_alloc(4, 3) == NULL, "non power-of-two align should fail");
+
+    /* small aligned run */
+    void *small = kmm_frames_alloc(16, 16);
+    ASSERT_TRUE(small != NULL, "16 frame run failed");
+    ASSERT_EQ((uint32_t)small % (16 * 4096), 0, "16 frame run misaligned");
+    ASSERT_EQ(kmm_get_used_frames(), used_before + 16, "used after 16 frame run");
+
+    /* 4MB run aligned to 4MB */
+    void *large = kmm_frames_alloc(1024, 1024);
+    ASSERT_TRUE(large != NULL, "1024 frame run failed");
+    ASSERT_EQ((uint32_t)large % (1024 * 4096), 0, "1024 frame run misaligned");
+    ASSERT_EQ(kmm_get_used_frames(), used_before + 16 + 1024, "used after 1024 frame run");
+
+    /* runs must not overlap */
+    uint32_t s = (uint32_t)small, l = (uint32_t)large;
+    ASSERT_TRUE(s + 16 * 4096 <= l || l + 1024 * 4096 <= s, "runs overlap");
+
+    /* a single frame must not come from inside either run */
+    void *single = kmm_frame_alloc();
+    ASSERT_TRUE(single != NULL, "single alloc failed");
+    uint32_t f = (uint32_t)single;
+    ASSERT_TRUE(f < s || f >= s + 16 * 4096, "single frame inside small run");
+    ASSERT_TRUE(f < l || f >= l + 1024 * 4096, "single frame inside large run");
+    kmm_frame_free(single);
+
+    kmm_frames_free(small, 16);
+    kmm_frames_free(large, 1024);
+    ASSERT_EQ(kmm_get_used_frames(), used_before, "used after frees");
+
+    /* freeing again must not change the counters */
+    kmm_frames_free(large, 1024);
+    ASSERT_EQ(kmm_get_used_frames(), used_before, "used after double free");
+
+    char dbg[128], num[16];
+    strcpy(dbg, "DBG frames_alloc: small=");
+    utoa(s, num); strcat(dbg, num);
+    strcat(dbg, " large="); utoa(l, num); strcat(dbg, num);
+
+    strcat(dbg, " PASSED");
+    send_msg(dbg);
+}
+/* ---------------- Frame Descriptor Tests ---------------- */
+void test_kmm_frame_desc()
+{
+    ensure_kmm_initialized();
+
+    ASSERT_TRUE(sizeof(frame_desc_t) <= 8, "descriptor larger than 8 bytes");
+
+    /* kernel image frames are tagged at init */
+    frame_desc_t *kdesc = kmm_frame_desc((void*)0x100000);
+    ASSERT_TRUE(kdesc != NULL, "no descriptor for kernel frame");
+    ASSERT_TRUE(kdesc->flags & KMM_FRAME_KERNEL, "kernel frame not tagged");
+    ASSERT_EQ(kdesc->refcount, 1, "kernel frame refcount");
+
+    uint32_t used_before = kmm_get_used_frames();
+
+    /* fresh frame starts with a single reference */
+    void *frame = kmm_frame_alloc();
+    ASSERT_TRUE(frame != NULL, "alloc failed");
+
+    frame_desc_t *desc = kmm_frame_desc(frame);
+    ASSERT_TRUE(desc != NULL, "no descriptor for frame");
+    ASSERT_EQ(desc->refcount, 1, "refcount after alloc");
+    ASSERT_EQ(desc->flags, 0, "flags after alloc");
+
+    kmm_frame_set_flags(frame, KMM_FRAME_USER);
+    ASSERT_TRUE(desc->flags & KMM_FRAME_USER, "flag not set");
+
+    /* extra reference keeps the frame alive */
+    ASSERT_EQ(kmm_frame_get(frame), 2, "refcount after get");
+    ASSERT_EQ(kmm_frame_put(frame), 1, "refcount after put");
+    ASSERT_EQ(kmm_get_used_frames(), used_before + 1, "frame freed too early");
+
+    /* last reference frees it */
+    ASSERT_EQ(kmm_frame_put(frame), 0, "refcount after last put");
+    ASSERT_EQ(kmm_get_used_frames(), used_before, "frame not freed on last put");
+    ASSERT_EQ(desc->flags, 0, "flags not cleared on free");
+
+    /* free frames cannot be referenced */
+    ASSERT_EQ(kmm_frame_get(frame), 0, "get on free frame");
+    ASSERT_EQ(kmm_frame_put(frame), 0, "put on free frame");
+
+    /* runs record their order on the first frame */
+    void *run = kmm_frames_alloc(5, 1);
+    ASSERT_TRUE(run != NULL, "run alloc failed");
+    ASSERT_EQ(kmm_frame_desc(run)->order, 3, "run order");
+    kmm_frames_free(run, 5);
+    ASSERT_EQ(kmm_frame_desc(run)->refcount, 0, "run refcount after free");
+
+    char dbg[128], num[16];
+    strcpy(dbg, "DBG frame_desc: size=");
+    utoa(sizeof(frame_desc_t), num); strcat(dbg, num);
+
+    strcat(dbg, " PASSED");
+    send_msg(dbg);
+}
+
+/* ---------------- Zero Pool Tests ---------------- */
+
+/* true if every byte of the frame reads as zero (through the physmap) */
+static bool frame_is_zero(void *frame)
+{
+    uint32_t *words = (uint32_t*)PHYS_TO_VIRT(frame);
+
+    for (uint32_t i = 0; i < 4096 / sizeof(uint32_t); i++) {
+        if (words[i] != 0) return false;
+    }
+
+    return true;
+}
+
+void test_kmm_zero_pool()
+{
+    ensure_kmm_initialized();
+
+    kmm_zero_pool_drain();
+
+    uint32_t used_before = kmm_get_used_frames();
+    kmm_zero_pool_stats_t before, after;
+    kmm_get_zero_pool_stats(&before);
+
+    ASSERT_EQ(before.pooled, 0, "pool not empty after drain");
+
+    /* idle refill runs in batches until the pool is full */
+    uint32_t calls = 0;
+    while (kmm_zero_pool_refill()) calls++;
+
+    kmm_get_zero_pool_stats(&after);
+    ASSERT_EQ(after.pooled, KMM_ZERO_POOL_SIZE, "pool not full after refill");
+    ASSERT_EQ(kmm_get_used_frames(), used_before + KMM_ZERO_POOL_SIZE, "pooled frames not accounted");
+
+    /* a pooled frame is handed out without a memset */
+    uint32_t start = (uint32_t)rdtsc();
+    void *hit = kmm_frame_alloc_zeroed();
+    uint32_t hit_cycles = (uint32_t)rdtsc() - start;
+
+    ASSERT_TRUE(hit != NULL, "zeroed alloc (hit) failed");
+    ASSERT_TRUE(frame_is_zero(hit), "pooled frame not zero");
+    ASSERT_TRUE(!(kmm_frame_desc(hit)->flags & KMM_FRAME_ZEROED), "zeroed flag kept after hand out");
+
+    kmm_get_zero_pool_stats(&after);
+    ASSERT_EQ(after.hits, before.hits + 1, "hit not counted");
+
+    /* dirty it and give it back */
+    memset(PHYS_TO_VIRT(hit), 0xAB, 4096);
+    kmm_frame_free(hit);
+
+    /* empty pool falls back to a memset */
+    kmm_zero_pool_drain();
+
+    start = (uint32_t)rdtsc();
+    void *miss = kmm_frame_alloc_zeroed();
+    uint32_t miss_cycles = (uint32_t)rdtsc() - start;
+
+    ASSERT_TRUE(miss != NULL, "zeroed alloc (miss) failed");
+    ASSERT_TRUE(frame_is_zero(miss), "fresh frame not zero");
+
+    kmm_get_zero_pool_stats(&after);
+    ASSERT_EQ(after.misses, before.misses + 1, "miss not counted");
+
+    kmm_frame_free(miss);
+
+    /* a zeroed batch empties the pool first and clears only the rest */
+    void *batch[KMM_ZERO_POOL_SIZE + 4];
+    while (kmm_zero_pool_refill());
+
+    kmm_get_zero_pool_stats(&before);
+    uint32_t taken = kmm_frame_alloc_batch_zeroed(batch, KMM_ZERO_POOL_SIZE + 4);
+    kmm_get_zero_pool_stats(&after);
+
+    ASSERT_EQ(taken, KMM_ZERO_POOL_SIZE + 4, "zeroed batch short");
+    ASSERT_EQ(after.hits, before.hits + KMM_ZERO_POOL_SIZE, "batch pool hits not counted");
+    ASSERT_EQ(after.misses, before.misses + 4, "batch misses not counted");
+    ASSERT_EQ(after.pooled, 0, "pool not used by the batch");
+
+    for (uint32_t i = 0; i < taken; i++)
+        ASSERT_TRUE(frame_is_zero(batch[i]), "batch frame not zero");
+
+    kmm_frame_free_batch(batch, taken);
+    ASSERT_EQ(kmm_get_used_frames(), used_before, "frames leaked");
+
+    char dbg[128], num[16];
+    strcpy(dbg, "DBG zero_pool: refill_calls=");
+    utoa(calls, num); strcat(dbg, num);
+    strcat(dbg, " hit_cycles="); utoa(hit_cycles, num); strcat(dbg, num);
+    strcat(dbg, " miss_cycles="); utoa(miss_cycles, num); strcat(dbg, num);
+
+    strcat(dbg, " PASSED");
+    send_msg(dbg);
+}
+
+void test_kmm_zones()
+{
+    ensure_kmm_initialized();
+
+    kmm_zone_stats_t dma, normal, high;
+    kmm_get_zone_stats(KMM_ZONE_DMA, &dma);
+    kmm_get_zone_stats(KMM_ZONE_NORMAL, &normal);
+    kmm_get_zone_stats(KMM_ZONE_HIGH, &high);
+
+    char dbg[160], num[16];
+    strcpy(dbg, "DBG zones: dma_free=");
+    utoa(dma.free, num); strcat(dbg, num);
+    strcat(dbg, " normal_free="); utoa(normal.free, num); strcat(dbg, num);
+    strcat(dbg, " high_free="); utoa(high.free, num); strcat(dbg, num);
+
+    /* zones tile the frames and account for every free frame */
+    ASSERT_EQ(dma.start, 0, "DMA zone does not start at frame 0");
+    ASSERT_EQ(normal.start, dma.end, "NORMAL zone does not follow DMA");
+    ASSERT_EQ(high.start, normal.end, "HIGH zone does not follow NORMAL");
+    ASSERT_EQ(high.end, kmm_get_total_frames(), "zones do not cover all frames");
+    ASSERT_EQ(dma.free + normal.free + high.free, kmm_get_total_frames() - kmm_get_used_frames(), "zone counters out of sync");
+
+    /* ordinary allocations leave the DMA zone alone while NORMAL has frames */
+    void *f = kmm_frame_alloc();
+    ASSERT_TRUE(f != NULL, "kmm_frame_alloc failed");
+
+    if (normal.free > 0)
+        ASSERT_TRUE((uint32_t)f >= KMM_ZONE_DMA_END, "ordinary frame taken from DMA zone");
+
+    kmm_zone_stats_t after;
+    kmm_get_zone_stats(KMM_ZONE_DMA, &after);
+    ASSERT_EQ(after.free, dma.free, "ordinary allocation changed DMA counter");
+
+    kmm_frame_free(f);
+
+    /* DMA allocations stay below 16MB and move the DMA counter */
+    void *d = kmm_frame_alloc_zone(KMM_ZONE_DMA);
+    ASSERT_TRUE(d != NULL, "DMA allocation failed");
+    ASSERT_TRUE((uint32_t)d < KMM_ZONE_DMA_END, "DMA frame above 16MB");
+
+    kmm_get_zone_stats(KMM_ZONE_DMA, &after);
+    ASSERT_EQ(after.free, dma.free - 1, "DMA counter not updated");
+
+    kmm_frame_free(d);
+
+    kmm_get_zone_stats(KMM_ZONE_DMA, &after);
+    ASSERT_EQ(after.free, dma.free, "DMA counter not restored");
+
+    /* HIGH falls back to NORMAL (or DMA) when there is no high memory */
+    void *h = kmm_frame_alloc_zone(KMM_ZONE_HIGH);
+    ASSERT_TRUE(h != NULL, "HIGH allocation failed");
+
+    if (high.free == 0)
+        ASSERT_TRUE((uint32_t)h < normal.end * 4096, "HIGH fallback out of range");
+
+    kmm_frame_free(h);
+
+    ASSERT_TRUE(kmm_frame_alloc_zone(KMM_ZONE_COUNT) == NULL, "invalid zone accepted");
+
+    strcat(dbg, " PASSED");
+    send_msg(dbg);
+}
+
+/* ---------------- Benchmarks ---------------- */
+
+/* kmm_init time in TSC cycles, run under different QEMU_MEM sizes */
+void test_kmm_init_cycles()
+{
+    ensure_kmm_initialized();
+
+    uint64_t cycles = kmm_get_init_cycles();
+    uint32_t total = kmm_get_total_frames();
+
+    ASSERT_TRUE(cycles != 0, "init cycles not recorded");
+
+    char dbg[128], num[16];
+    strcpy(dbg, "DBG init_cycles: mem_mb=");
+    utoa(total / 256, num); strcat(dbg, num);
+
+    /* cycles fit 32 bits with the word-at-a-time init, saturate otherwise */
+    strcat(dbg, " cycles=");
+    utoa((cycles >> 32) ? 0xFFFFFFFF : (uint32_t)cycles, num); strcat(dbg, num);
+
+    strcat(dbg, " PASSED");
+    send_msg(dbg);
+}
+
+/* frames taken to reach a given occupancy are kept here (not in the frames
+   themselves, they may not be reachable through the physmap) */
+#define KMM_BENCH_MAX_FRAMES    32768
+#define KMM_BENCH_SAMPLES       64
+
+static void *bench_frames[KMM_BENCH_MAX_FRAMES];
+static uint32_t bench_count;
+
+/* allocate frames until the given percentage of all frames is in use and
+   return the percentage reached. above 128MiB the bench_frames store runs
+   out first and the occupancy stays below the target */
+static uint32_t bench_fill_to(uint32_t percent)
+{
+    uint32_t total = kmm_get_total_frames();
+    uint32_t target = (total / 100) * percent;
+
+    while (kmm_get_used_frames() < target && bench_count < KMM_BENCH_MAX_FRAMES) {
+        void *f = kmm_frame_alloc();
+        if (!f) break;
+        bench_frames[bench_count++] = f;
+    }
+
+    return total ? (kmm_get_used_frames() * 100) / total : 0;
+}
+
+/* average cycles for a single kmm_frame_alloc() at the current occupancy */
+static uint32_t bench_alloc_cycles(void)
+{
+    void *frames[KMM_BENCH_SAMPLES];
+    uint32_t cycles = 0;
+    uint32_t n;
+
+    for (n = 0; n < KMM_BENCH_SAMPLES; n++) {
+        uint32_t start = (uint32_t)rdtsc();
+        frames[n] = kmm_frame_alloc();
+        cycles += (uint32_t)rdtsc() - start;
+
+        if (!frames[n]) break;
+    }
+
+    free_all(frames, n);
+
+    return n ? cycles / n : 0;
+}
+
+void test_kmm_bench_occupancy()
+{
+    ensure_kmm_initialized();
+
+    static const uint32_t levels[] = { 10, 50, 95 };
+    uint32_t before_used = kmm_get_used_frames();
+
+    char dbg[192], num[16];
+    strcpy(dbg, "DBG bench_occupancy cycles/alloc:");
+
+    bench_count = 0;
+
+    for (uint32_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        uint32_t reached = bench_fill_to(levels[i]);
+
+        uint32_t cycles = bench_alloc_cycles();
+
+        /* the occupancy actually measured, when short of the target */
+        strcat(dbg, " "); utoa(levels[i], num); strcat(dbg, num);
+        if (reached < levels[i]) {
+            strcat(dbg, "%(at "); utoa(reached, num); strcat(dbg, num);
+            strcat(dbg, "%)");
+        } else {
+            strcat(dbg, "%");
+        }
+        strcat(dbg, "="); utoa(cycles, num); strcat(dbg, num);
+    }
+
+    free_all(bench_frames, bench_count);
+
+    ASSERT_EQ(kmm_get_used_frames(), before_used, "benchmark leaked frames");
+
+    strcat(dbg, " PASSED");
+    send_msg(dbg);
+}
+
+/* cost of the free path (validation included), as bulk frees from
+   vmm_free_region and page-table teardown see it */
+#define KMM_BENCH_FREE_FRAMES   1024
+
+void test_kmm_bench_free()
+{
+    ensure_kmm_initialized();
+
+    uint32_t before_used = kmm_get_used_frames();
+    uint32_t n;
+
+    for (n = 0; n < KMM_BENCH_FREE_FRAMES && n < KMM_BENCH_MAX_FRAMES; n++) {
+        bench_frames[n] = kmm_frame_alloc();
+        if (!bench_frames[n]) break;
+    }
+
+    ASSERT_TRUE(n > 0, "no frames allocated");
+
+    uint32_t start = (uint32_t)rdtsc();
+    free_all(bench_frames, n);
+    uint32_t single_cycles = ((uint32_t)rdtsc() - start) / n;
+
+    /* rejected frees (reserved frames) should be just as cheap */
+    start = (uint32_t)rdtsc();
+    for (uint32_t i = 0; i < n; i++)
+        kmm_frame_free((void*)0x100000);
+    uint32_t reserved_cycles = ((uint32_t)rdtsc() - start) / n;
+
+    /* one contiguous run freed at once */
+    void *run = kmm_frames_alloc(KMM_BENCH_FREE_FRAMES, 1);
+    ASSERT_TRUE(run != NULL, "run allocation failed");
+
+    start = (uint32_t)rdtsc();
+    kmm_frames_free(run, KMM_BENCH_FREE_FRAMES);
+    uint32_t run_cycles = (uint32_t)rdtsc() - start;
+
+    ASSERT_EQ(kmm_get_used_frames(), before_used, "benchmark leaked frames");
+
+    char dbg[128], num[16];
+    strcpy(dbg, "DBG bench_free cycles: free=");
+    utoa(single_cycles, num); strcat(dbg, num);
+    strcat(dbg, " reserved="); utoa(reserved_cycles, num); strcat(dbg, num);
+    strcat(dbg, " run1024="); utoa(run_cycles, num); strcat(dbg, num);
+
+    strcat(dbg, " PASSED");
+    send_msg(dbg);
+}
+
+/* multi-frame region churn, as vmm_alloc_region/vmm_free_region produce it.
+   build once with the bitmap and once with KMM_BUDDY=1 to compare */
+#define KMM_BENCH_REGIONS       256
+#define KMM_BENCH_REGION_FRAMES 16
+
+void test_kmm_bench_regions()
+{
+    ensure_kmm_initialized();
+
+    static void *regions[KMM_BENCH_REGIONS];
+    uint32_t before_used = kmm_get_used_frames();
+
+    /* fragment low memory: keep every other single frame */
+    bench_count = 0;
+
+    for (uint32_t i = 0; i < 2048 && bench_count < KMM_BENCH_MAX_FRAMES; i++) {
+        void *f = kmm_frame_alloc();
+        if (!f) break;
+        bench_frames[bench_count++] = f;
+    }
+
+    for (uint32_t i = 0; i < bench_count; i += 2) {
+        kmm_frame_free(bench_frames[i]);
+        bench_frames[i] = NULL;
+    }
+
+    /* allocate and free regions repeatedly, interleaved with single frames */
+    uint32_t region_cycles = 0, frame_cycles = 0, allocated = 0;
+
+    for (uint32_t round = 0; round < 4; round++) {
+        for (uint32_t i = 0; i < KMM_BENCH_REGIONS; i++) {
+            uint32_t start = (uint32_t)rdtsc();
+            regions[i] = kmm_frames_alloc(KMM_BENCH_REGION_FRAMES, 1);
+            region_cycles += (uint32_t)rdtsc() - start;
+
+            ASSERT_TRUE(regions[i] != NULL, "region allocation failed");
+            allocated++;
+        }
+
+        frame_cycles += bench_alloc_cycles();
+
+        /* free in an interleaved order so holes of different sizes appear */
+        for (uint32_t i = 0; i < KMM_BENCH_REGIONS; i += 2)
+            kmm_frames_free(regions[i], KMM_BENCH_REGION_FRAMES);
+        for (uint32_t i = 1; i < KMM_BENCH_REGIONS; i += 2)
+            kmm_frames_free(regions[i], KMM_BENCH_REGION_FRAMES);
+    }
+
+    free_all(bench_frames, bench_count);
+
+    ASSERT_EQ(kmm_get_used_frames(), before_used, "benchmark leaked frames");
+
+    char dbg[192], num[16];
+#ifdef KMM_BUDDY
+    strcpy(dbg, "DBG bench_regions buddy");
+#else
+    strcpy(dbg, "DBG bench_regions bitmap");
+#endif
+    strcat(dbg, " cycles/region="); utoa(region_cycles / allocated, num); strcat(dbg, num);
+    strcat(dbg, " cycles/frame="); utoa(frame_cycles / 4, num); strcat(dbg, num);
+
+#ifdef KMM_BUDDY
+    /* per-order free block counts show how fragmented memory is afterwards */
+    strcat(dbg, " free_blocks=");
+    for (uint32_t order = 0; order <= KMM_BUDDY_MAX_ORDER; order++) {
+        if (order) strcat(dbg, ",");
+        utoa(kmm_get_free_blocks(order), num); strcat(dbg, num);
+    }
+#endif
+
+    strcat(dbg, " PASSED");
+    send_msg(dbg);
+}
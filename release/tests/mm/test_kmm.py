@@ -102,3 +102,59 @@ def test_kmm_pattern(runner):
 def test_kmm_oom(runner):
     result = runner.send_serial("kmm_oom")
     assert_passed(result)
+
+
+def test_kmm_frames_alloc(runner):
+    result = runner.send_serial("kmm_frames_alloc")
+    assert_passed(result)
+
+
+def test_kmm_frame_desc(runner):
+    result = runner.send_serial("kmm_frame_desc")
+    assert_passed(result)
+
+
+def test_kmm_zero_pool(runner):
+    result = runner.send_serial("kmm_zero_pool")
+    print(result)
+    assert_passed(result)
+
+
+def test_kmm_zones(runner):
+    result = runner.send_serial("kmm_zones")
+    print(result)
+    assert_passed(result)
+
+
+def test_kmm_init_cycles(runner):
+    # reports kmm_init time in TSC cycles, compare across memory sizes with
+    # make test QEMU_MEM=128M / 1G / 3584M
+    result = runner.send_serial("kmm_init_cycles")
+    print(result)
+    assert_passed(result)
+
+
+def test_kmm_bench_occupancy(runner):
+    # reports average kmm_frame_alloc() cycles at 10%, 50% and 95% occupancy;
+    # a level the frame store cannot reach shows the occupancy measured, e.g.
+    # "95%(at 40%)=..." with more than 128MiB of memory
+    result = runner.send_serial("kmm_bench_occupancy", timeout=30)
+    print(result)
+    assert_passed(result)
+
+
+def test_kmm_bench_regions(runner):
+    # reports cycles per 16-frame region and per single frame under region
+    # churn. run once as is and once after building with KMM_BUDDY=1 to
+    # compare the bitmap and buddy allocators
+    result = runner.send_serial("kmm_bench_regions", timeout=30)
+    print(result)
+    assert_passed(result)
+
+
+def test_kmm_bench_free(runner):
+    # reports cycles per kmm_frame_free (accepted and rejected) and for one
+    # 1024-frame kmm_frames_free
+    result = runner.send_serial("kmm_bench_free", timeout=30)
+    print(result)
+    assert_passed(result)
@@ -76,3 +76,239 @@ def test_clone_pagetable(runner):
 # Test # 15
 def test_clone_dir(runner):
     assert "PASSED*" in runner.send_serial("vmm_clone_dir")
+
+
+# Test # 16
+def test_pae(runner):
+    assert "PASSED*" in runner.send_serial("vmm_pae")
+
+
+# Test # 17
+def test_bench_map(runner):
+    # reports cycles to map and unmap 16MB page by page (one kmm call per
+    # page, one TLB flush per page on unmap, frames cleared the same way on
+    # both paths) and through the batched
+    # vmm_alloc_region / vmm_free_region, plus the map speedup in tenths and
+    # whether it reaches the 5x target
+    result = runner.send_serial("vmm_bench_map", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 18
+def test_large_pages(runner):
+    assert "PASSED*" in runner.send_serial("vmm_large_pages")
+
+
+# Test # 19
+def test_global_pages(runner):
+    assert "PASSED*" in runner.send_serial("vmm_global_pages")
+
+
+# Test # 20
+def test_bench_switch(runner):
+    # reports cycles per CR3 switch between 8 cloned directories and for 64
+    # kernel reads right after each switch. global kernel pages (pge=1) keep
+    # their TLB entries across the switch
+    result = runner.send_serial("vmm_bench_switch", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 21
+def test_kernel_template(runner):
+    assert "PASSED*" in runner.send_serial("vmm_kernel_template")
+
+
+# Test # 22
+def test_clone_cow(runner):
+    assert "PASSED*" in runner.send_serial("vmm_clone_cow")
+
+
+# Test # 23
+def test_bench_clone(runner):
+    # reports cycles and frames used to clone a 1/16/64MB user region eagerly
+    # (vmm_clone_pagedir) and copy-on-write (vmm_clone_pagedir_cow), plus the
+    # cost of the first write fault. eager clones that would not fit in
+    # memory are skipped
+    result = runner.send_serial("vmm_bench_clone", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 24
+def test_lazy_region(runner):
+    assert "PASSED*" in runner.send_serial("vmm_lazy_region")
+
+
+# Test # 25
+def test_bench_lazy(runner):
+    # reports cycles and resident frames for an eager and a VMM_LAZY 16MB
+    # vmm_alloc_region, and the cycles per first-touch fault afterwards
+    result = runner.send_serial("vmm_bench_lazy", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 26
+def test_fault_classes(runner):
+    assert "PASSED*" in runner.send_serial("vmm_fault_classes")
+
+
+# Test # 27
+def test_fault_stats(runner):
+    # reports the page faults taken so far by class of resolver and the
+    # histogram of cycles per resolved fault (power-of-two buckets)
+    result = runner.send_serial("vmm_fault_stats")
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 28
+def test_vma_tree(runner):
+    assert "PASSED*" in runner.send_serial("vmm_vma_tree")
+
+
+# Test # 29
+def test_bench_vma(runner):
+    # reports cycles per VMA lookup and insert, and the tree height, with
+    # 16, 64, 256 and 1024 VMAs in one address space
+    result = runner.send_serial("vmm_bench_vma", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 30
+def test_pt_counters(runner):
+    assert "PASSED*" in runner.send_serial("vmm_pt_counters")
+
+
+# Test # 31
+def test_bench_scattered_free(runner):
+    # reports cycles per vmm_free_region of 1024 scattered one-page regions,
+    # and the cycles of the page table scan the in-use counter replaced
+    result = runner.send_serial("vmm_bench_free", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 32
+def test_tlb_batch(runner):
+    assert "PASSED*" in runner.send_serial("vmm_tlb_batch")
+
+
+# Test # 33
+def test_bench_tlb(runner):
+    # reports cycles to invalidate n pages (1 to 64) and refill a 64 page
+    # working set, with one invlpg per page and with a full TLB flush, and
+    # the smallest n where the full flush wins
+    result = runner.send_serial("vmm_bench_tlb", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 34
+def test_recursive(runner):
+    assert "PASSED*" in runner.send_serial("vmm_recursive")
+
+
+# Test # 35
+def test_bench_walk(runner):
+    # reports cycles per vmm_get_phys_addr and vmm_map_page in the loaded
+    # address space (through the recursive mapping with VMM_RECURSIVE=1) and
+    # in another one (through the physmap)
+    result = runner.send_serial("vmm_bench_walk", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 36
+def test_map_range(runner):
+    assert "PASSED*" in runner.send_serial("vmm_map_range")
+
+
+# Test # 37
+def test_bench_map_range(runner):
+    # reports cycles to map 16MB with one vmm_map_page per page, with
+    # vmm_map_range on small and on large pages, and what vmm_init spent on
+    # the identity map and the physmap at boot
+    result = runner.send_serial("vmm_bench_range", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 38
+def test_xlate_cache(runner):
+    assert "PASSED*" in runner.send_serial("vmm_xlate_cache")
+
+
+# Test # 39
+def test_bench_xlate(runner):
+    # reports cycles per vmm_get_phys_addr and the translation cache hit rate
+    # over 16 and 256 pages, and the cycles to translate a 1MB buffer page by
+    # page and with vmm_translate_range
+    result = runner.send_serial("vmm_bench_xlate", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 40
+def test_ws_scan(runner):
+    assert "PASSED*" in runner.send_serial("vmm_ws_scan")
+
+
+# Test # 41
+def test_bench_ws(runner):
+    # reports the resident set and working set of a 16MB region with every
+    # fourth page touched, and the scan cost per page with and without accesses
+    result = runner.send_serial("vmm_bench_ws", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 42
+def test_swap(runner):
+    assert "PASSED*" in runner.send_serial("vmm_swap")
+
+
+# Test # 43
+def test_bench_swap(runner):
+    # reports the cycles per page to evict a 1MB region to the RAM swap area
+    # and to fault it back in
+    result = runner.send_serial("vmm_bench_swap", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 44
+def test_zero_page(runner):
+    assert "PASSED*" in runner.send_serial("vmm_zero_page")
+
+
+# Test # 45
+def test_bench_zero_page(runner):
+    # reads every page of a lazy 64MB region and reports the frames it took
+    # (only its page tables) and the cycles per read fault
+    result = runner.send_serial("vmm_bench_zero_page", timeout=60)
+    print(result)
+    assert "PASSED*" in result
+
+
+# Test # 46
+def test_clone_oom(runner):
+    assert "PASSED*" in runner.send_serial("vmm_clone_oom", timeout=60)
+
+
+# Test # 47
+def test_guard_limit(runner):
+    assert "PASSED*" in runner.send_serial("vmm_guard_limit")
+
+
+# Test # 48
+def test_page_free_tlb(runner):
+    assert "PASSED*" in runner.send_serial("vmm_page_free_tlb")
+
+
+# Test # 49
+def test_heap_frames(runner):
+    assert "PASSED*" in runner.send_serial("vmm_heap_frames")
@@ -12,6 +12,14 @@ extern void test_kmm_free_invalid(void);
 extern void test_kmm_consistency(void);
 extern void test_kmm_pattern_alloc_free(void);
 extern void test_kmm_oom(void);
+extern void test_kmm_frames_alloc(void);
+extern void test_kmm_frame_desc(void);
+extern void test_kmm_zero_pool(void);
+extern void test_kmm_zones(void);
+extern void test_kmm_init_cycles(void);
+extern void test_kmm_bench_occupancy(void);
+extern void test_kmm_bench_regions(void);
+extern void test_kmm_bench_free(void);
 
 // ----------------- KHEAP (buddy allocator) tests -----------------
 extern void test_kheap_init(void);
@@ -45,5 +53,39 @@ extern void test_vmm_get_phys_frame(void); // 7
 extern void test_vmm_double_mapping(void); // 13 
 extern void test_vmm_clone_pagetable(void); // 14
 extern void test_vmm_clone_pagedir(void); // 15
+extern void test_vmm_pae(void); // 16
+extern void test_vmm_bench_map(void); // 17
+extern void test_vmm_large_pages(void); // 18
+extern void test_vmm_global_pages(void); // 19
+extern void test_vmm_bench_switch(void); // 20
+extern void test_vmm_kernel_template(void); // 21
+extern void test_vmm_clone_cow(void); // 22
+extern void test_vmm_bench_clone(void); // 23
+extern void test_vmm_lazy_region(void); // 24
+extern void test_vmm_bench_lazy(void); // 25
+extern void test_vmm_fault_classes(void); // 26
+extern void test_vmm_fault_stats(void); // 27
+extern void test_vmm_vma_tree(void); // 28
+extern void test_vmm_bench_vma(void); // 29
+extern void test_vmm_pt_counters(void); // 30
+extern void test_vmm_bench_scattered_free(void); // 31
+extern void test_vmm_tlb_batch(void); // 32
+extern void test_vmm_bench_tlb(void); // 33
+extern void test_vmm_recursive(void); // 34
+extern void test_vmm_bench_walk(void); // 35
+extern void test_vmm_map_range(void); // 36
+extern void test_vmm_bench_map_range(void); // 37
+extern void test_vmm_xlate_cache(void); // 38
+extern void test_vmm_bench_xlate(void); // 39
+extern void test_vmm_ws_scan(void); // 40
+extern void test_vmm_bench_ws(void); // 41
+extern void test_vmm_swap(void); // 42
+extern void test_vmm_bench_swap(void); // 43
+extern void test_vmm_zero_page(void); // 44
+extern void test_vmm_bench_zero_page(void); // 45
+extern void test_vmm_clone_oom(void); // 46
+extern void test_vmm_guard_limit(void); // 47
+extern void test_vmm_page_free_tlb(void); // 48
+extern void test_vmm_heap_frames(void); // 49
 
 #endif // _MM_TESTS_H
\ No newline at end of file
@@ -85,6 +85,14 @@ static struct test_case test_cases[] = {
     { "kmm_consistency",      	test_kmm_consistency },
     { "kmm_pattern",          	test_kmm_pattern_alloc_free },
     { "kmm_oom",              	test_kmm_oom },
+    { "kmm_frames_alloc",     	test_kmm_frames_alloc },
+    { "kmm_frame_desc",       	test_kmm_frame_desc },
+    { "kmm_zero_pool",        	test_kmm_zero_pool },
+    { "kmm_zones",            	test_kmm_zones },
+    { "kmm_init_cycles",      	test_kmm_init_cycles },
+    { "kmm_bench_occupancy",  	test_kmm_bench_occupancy },
+    { "kmm_bench_regions",    	test_kmm_bench_regions },
+    { "kmm_bench_free",       	test_kmm_bench_free },
 
     // // ---- VMM tests ----
 	{ "vmm_init",             	test_vmm_init },
@@ -94,6 +102,40 @@ static struct test_case test_cases[] = {
     { "vmm_switch_dir",       	test_vmm_switch_pagedir },
     { "vmm_create_pt",        	test_vmm_create_pt },
     { "vmm_map_basic",        	test_vmm_map_page_basic },
+    { "vmm_pae",              	test_vmm_pae },
+    { "vmm_bench_map",        	test_vmm_bench_map },
+    { "vmm_large_pages",      	test_vmm_large_pages },
+    { "vmm_global_pages",     	test_vmm_global_pages },
+    { "vmm_bench_switch",     	test_vmm_bench_switch },
+    { "vmm_kernel_template",  	test_vmm_kernel_template },
+    { "vmm_clone_cow",        	test_vmm_clone_cow },
+    { "vmm_bench_clone",      	test_vmm_bench_clone },
+    { "vmm_lazy_region",      	test_vmm_lazy_region },
+    { "vmm_bench_lazy",       	test_vmm_bench_lazy },
+    { "vmm_fault_classes",    	test_vmm_fault_classes },
+    { "vmm_fault_stats",      	test_vmm_fault_stats },
+    { "vmm_vma_tree",         	test_vmm_vma_tree },
+    { "vmm_bench_vma",        	test_vmm_bench_vma },
+    { "vmm_pt_counters",      	test_vmm_pt_counters },
+    { "vmm_bench_free",       	test_vmm_bench_scattered_free },
+    { "vmm_tlb_batch",        	test_vmm_tlb_batch },
+    { "vmm_bench_tlb",        	test_vmm_bench_tlb },
+    { "vmm_recursive",        	test_vmm_recursive },
+    { "vmm_bench_walk",       	test_vmm_bench_walk },
+    { "vmm_map_range",        	test_vmm_map_range },
+    { "vmm_bench_range",      	test_vmm_bench_map_range },
+    { "vmm_xlate_cache",      	test_vmm_xlate_cache },
+    { "vmm_bench_xlate",      	test_vmm_bench_xlate },
+    { "vmm_ws_scan",          	test_vmm_ws_scan },
+    { "vmm_bench_ws",         	test_vmm_bench_ws },
+    { "vmm_swap",             	test_vmm_swap },
+    { "vmm_bench_swap",       	test_vmm_bench_swap },
+    { "vmm_zero_page",        	test_vmm_zero_page },
+    { "vmm_bench_zero_page",  	test_vmm_bench_zero_page },
+    { "vmm_clone_oom",        	test_vmm_clone_oom },
+    { "vmm_guard_limit",      	test_vmm_guard_limit },
+    { "vmm_page_free_tlb",    	test_vmm_page_free_tlb },
+    { "vmm_heap_frames",      	test_vmm_heap_frames },
     // { "vmm_page_alloc",       	test_vmm_page_alloc },
     // { "vmm_page_free",        	test_vmm_page_free },
 	// { "vmm_alloc_region",		test_vmm_alloc_region},
@@ -178,4 +220,28 @@ size_t read_command () {
 void send_msg (const char *msg) {
 	serial_puts (msg);
 	serial_putc ('*'); // end of message marker
+}
+
+/* Minimal unsigned int -> string converter, for the numbers benchmarks
+	report in their messages. */
+
+void utoa (unsigned val, char *buf) {
+	char tmp[16];
+	int i = 0, j = 0;
+
+	if (val == 0) {
+		buf[0] = '0';
+		buf[1] = '\0';
+		return;
+	}
+
+	while (val > 0 && i < (int)sizeof(tmp)) {
+		tmp[i++] = '0' + (val % 10);
+		val /= 10;
+	}
+
+	while (i > 0) {
+		buf[j++] = tmp[--i];
+	}
+	buf[j] = '\0';
 }
\ No newline at end of file
@@ -25,6 +25,11 @@ size_t 	read_command ();
 
 void 	send_msg (const char *msg);
 
+/* Minimal unsigned int -> string converter, for the numbers benchmarks
+	report in their messages. */
+
+void 	utoa (unsigned val, char *buf);
+
 
 /* Useful macros. */
 